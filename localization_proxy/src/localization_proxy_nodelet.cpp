@@ -0,0 +1,21 @@
+#include "localization_proxy/localization_proxy.hpp"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace swarm_localization_pkg
+{
+    class LocalProxyNodelet : public nodelet::Nodelet
+    {
+        public:
+            LocalProxyNodelet() {}
+        private:
+            LocalProxy * proxy = nullptr;
+            virtual void onInit() override
+            {
+                //LocalProxy is not thread-safe, keep it on the single threaded queue
+                ros::NodeHandle & n = getPrivateNodeHandle();
+                proxy = new LocalProxy(n);
+            }
+    };
+    PLUGINLIB_EXPORT_CLASS(swarm_localization_pkg::LocalProxyNodelet, nodelet::Nodelet);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <map>
+#include "ros/ros.h"
+#include <swarm_msgs/swarm_types.hpp>
+#include <swarm_msgs/swarm_drone_basecoor.h>
+
+using namespace Swarm;
+
+//Predictor of follower in compute offload mode. Leader broadcasts coordinate offsets (anchors) of all drones,
+//follower only moves its vo by them, no solver is needed while leader is alive.
+//Estimate frame of follower is its own vo frame, same as a solver initialized by itself.
+class AnchorPredictor {
+    std::map<int, Pose> anchors;
+    std::map<int, Eigen::Matrix4d> anchor_covs;
+    ros::Time t_recv;
+    int leader_id = -1;
+
+public:
+    //Anchors of the leader with smallest id are used; other leaders take over when it goes silent
+    void on_anchors_recv(const swarm_msgs::swarm_drone_basecoor & msg, double timeout) {
+        ros::Time now = ros::Time::now();
+        bool stale = (now - t_recv).toSec() > timeout;
+        if (leader_id >= 0 && !stale && msg.self_id > leader_id) {
+            return;
+        }
+        if (msg.self_id != leader_id) {
+            ROS_INFO("Follow anchors of leader %d", msg.self_id);
+        }
+
+        leader_id = msg.self_id;
+        t_recv = now;
+        anchors.clear();
+        anchor_covs.clear();
+        for (unsigned int i = 0; i < msg.ids.size(); i++) {
+            int _id = msg.ids[i];
+            anchors[_id] = Pose(msg.drone_basecoor[i], msg.drone_baseyaw[i]);
+            Eigen::Matrix4d cov = Eigen::Matrix4d::Zero();
+            cov(0, 0) = msg.position_cov[i].x;
+            cov(1, 1) = msg.position_cov[i].y;
+            cov(2, 2) = msg.position_cov[i].z;
+            cov(3, 3) = msg.yaw_cov[i];
+            anchor_covs[_id] = cov;
+        }
+    }
+
+    bool leader_alive(double timeout) const {
+        return leader_id >= 0 && (ros::Time::now() - t_recv).toSec() < timeout;
+    }
+
+    int leader() const {
+        return leader_id;
+    }
+
+    bool can_predict(int self_id, double timeout) const {
+        return leader_alive(timeout) && anchors.find(self_id) != anchors.end();
+    }
+
+    //vo_vels: velocity of each drone in its own vo frame
+    SwarmFrameState predict(const SwarmFrame & sf, int self_id, const std::map<int, Eigen::Vector3d> & vo_vels) const {
+        SwarmFrameState sfs;
+        const Pose & self_anchor = anchors.at(self_id);
+        for (auto & it : sf.id2nodeframe) {
+            int _id = it.first;
+            if (anchors.find(_id) == anchors.end() || !it.second.vo_available) {
+                continue;
+            }
+            //Offset of this drone in vo frame of self
+            Pose base_coor = Pose::DeltaPose(self_anchor, anchors.at(_id), true);
+            sfs.node_poses[_id] = base_coor * it.second.pose();
+            sfs.node_covs[_id] = anchor_covs.at(_id);
+            auto vel = vo_vels.find(_id);
+            if (vel != vo_vels.end()) {
+                sfs.node_vels[_id] = base_coor.att() * vel->second;
+            } else {
+                sfs.node_vels[_id] = Eigen::Vector3d(0, 0, 0);
+            }
+            sfs.base_coor_poses[_id] = base_coor;
+            sfs.base_coor_covs[_id] = anchor_covs.at(_id);
+        }
+        return sfs;
+    }
+};
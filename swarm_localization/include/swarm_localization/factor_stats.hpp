@@ -0,0 +1,72 @@
+#pragma once
+#include <map>
+#include <tuple>
+#include <string>
+#include <algorithm>
+
+//Residual statistics of factors in last solve, grouped by factor type and drone pair
+struct FactorStats {
+    enum FactorType {
+        Frame = 0,
+        Horizon = 1,
+        Loop = 2,
+        Detection = 3,
+        Consensus = 4
+    };
+
+    int type = 0;
+    //Pair is ordered so that id_a <= id_b; swarm frame factors are split into their distance residuals by pair
+    int id_a = -1;
+    int id_b = -1;
+    int count = 0;
+    //Cost after robust loss, same scale as cost of ceres
+    double cost = 0;
+    //RMS of whitened residuals of one factor, in std
+    double error_sum = 0;
+    double error_max = 0;
+    //Weight of huber loss, 1 for inliers and smaller for down-weighted factors
+    double weight_sum = 0;
+    int downweighted = 0;
+
+    void add(double _cost, double error, double weight) {
+        count ++;
+        cost += _cost;
+        error_sum += error;
+        error_max = std::max(error_max, error);
+        weight_sum += weight;
+        if (weight < 1.0) {
+            downweighted ++;
+        }
+    }
+
+    void merge(const FactorStats & stats) {
+        count += stats.count;
+        cost += stats.cost;
+        error_sum += stats.error_sum;
+        error_max = std::max(error_max, stats.error_max);
+        weight_sum += stats.weight_sum;
+        downweighted += stats.downweighted;
+    }
+
+    double error_mean() const {
+        return count > 0 ? error_sum / count : 0;
+    }
+
+    double weight_mean() const {
+        return count > 0 ? weight_sum / count : 0;
+    }
+
+    static std::string type_name(int type) {
+        switch (type) {
+            case Frame: return "swarm_frame";
+            case Horizon: return "horizon";
+            case Loop: return "loop";
+            case Detection: return "detection";
+            case Consensus: return "consensus";
+        }
+        return "unknown";
+    }
+};
+
+//(type, id_a, id_b) -> stats
+typedef std::map<std::tuple<int, int, int>, FactorStats> FactorStatsMap;
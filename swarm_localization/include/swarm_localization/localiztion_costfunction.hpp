@@ -418,7 +418,21 @@ struct SwarmFrameError {
         return res_count;
     }
 
-
+    //Drone pair of each residual, in same order as operator()
+    std::vector<std::pair<int, int>> residual_pairs() const {
+        std::vector<std::pair<int, int>> pairs;
+        for (auto it : sf.id2nodeframe) {
+            NodeFrame &_nf = it.second;
+            if (_nf.frame_available && _nf.dists_available) {
+                for (const auto & it2 : _nf.dis_map) {
+                    if (has_id(it2.first) && _nf.distance_available(it2.first)) {
+                        pairs.push_back(std::make_pair(_nf.id, it2.first));
+                    }
+                }
+            }
+        }
+        return pairs;
+    }
 
     template<typename T>
     bool operator()(T const *const *_poses, T *_residual) const {
@@ -552,8 +566,61 @@ struct SwarmHorizonError {
     }
 };
 
+//Proximal term of decentralized mode, keep self pose close to last consensus estimate
+struct SwarmConsensusError {
+    Pose pose_consensus;
+    bool yaw_observability;
+    double yaw_init;
+    Eigen::Vector3d pos_std;
+    double ang_std;
+
+    SwarmConsensusError(const Pose & _pose_consensus, bool _yaw_observability, double _yaw_init, Eigen::Vector3d _pos_std, double _ang_std) :
+        pose_consensus(_pose_consensus),
+        yaw_observability(_yaw_observability),
+        yaw_init(_yaw_init),
+        pos_std(_pos_std),
+        ang_std(_ang_std) {
+    }
+
+    int residual_count() {
+        return 4;
+    }
+
+    template<typename T>
+    bool operator()(T const *const *_poses, T *_residual) const {
+        T est_pose[4], con_pose[4];
+        est_pose[0] = _poses[0][0];
+        est_pose[1] = _poses[0][1];
+        est_pose[2] = _poses[0][2];
+        if (yaw_observability) {
+            est_pose[3] = _poses[0][3];
+        } else {
+            est_pose[3] = T(yaw_init);
+        }
+        Pose _pose_consensus = pose_consensus;
+        _pose_consensus.to_vector_xyzyaw(con_pose);
+        pose_error(est_pose, con_pose, _residual, pos_std, ang_std);
+        return true;
+    }
+};
+
+//Plus of x, y, z, yaw pose: euclidean on position and SO(2) on yaw, so yaw stays in [-pi, pi) while iterating
+struct PoseXYZYawPlus {
+    template<typename T>
+    bool operator()(const T * pose, const T * delta, T * pose_plus_delta) const {
+        pose_plus_delta[0] = pose[0] + delta[0];
+        pose_plus_delta[1] = pose[1] + delta[1];
+        pose_plus_delta[2] = pose[2] + delta[2];
+        pose_plus_delta[3] = wrap_angle(pose[3] + delta[3]);
+        return true;
+    }
+};
+
+typedef ceres::AutoDiffLocalParameterization<PoseXYZYawPlus, 4, 4> PoseXYZYawParameterization;
+
 #define AUTODIFF_STRIDE 4
 typedef ceres::DynamicAutoDiffCostFunction<SwarmFrameError, AUTODIFF_STRIDE>  SFErrorCost;
 typedef ceres::DynamicAutoDiffCostFunction<SwarmHorizonError, AUTODIFF_STRIDE> HorizonCost;
 typedef ceres::DynamicAutoDiffCostFunction<SwarmLoopError, AUTODIFF_STRIDE> LoopCost;
+typedef ceres::DynamicAutoDiffCostFunction<SwarmConsensusError, AUTODIFF_STRIDE> ConsensusCost;
 typedef ceres::DynamicAutoDiffCostFunction<SwarmDetectionError, AUTODIFF_STRIDE> DetectionCost;
\ No newline at end of file
@@ -0,0 +1,274 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include <ros/ros.h>
+#include <swarm_msgs/LoopConnection.h>
+#include <swarm_msgs/swarm_types.hpp>
+#include "swarm_localization/swarm_localization_params.hpp"
+
+//Loops of a drone pair beyond this are evicted, rejected ones first; loops leaving sliding window are evicted by drop_before
+#define PCM_MAX_GROUP_SIZE 100
+
+//Pairwise consistency maximization of loops, run on each pair of drones independently.
+//Loop i and j of drone a and b are consistent if the cycle b_i -> a_i -> a_j -> b_j -> b_i by loops and vo is near identity,
+//and only the maximum consistent set of each pair is used by solver.
+class LoopPCM {
+    typedef std::tuple<int, int64_t, int, int64_t> LoopKey;
+
+    struct LoopEntry {
+        LoopKey key;
+        //Normalized so that id_a <= id_b
+        Swarm::Pose vo_a;
+        Swarm::Pose vo_b;
+        Swarm::Pose rel_pose;
+    };
+
+    struct LoopGroup {
+        std::vector<LoopEntry> loops;
+        std::vector<std::vector<bool>> consistent;
+        std::set<int> clique;
+    };
+
+    std::map<std::pair<int, int>, LoopGroup> groups;
+    std::set<LoopKey> inliers;
+    double threshold;
+
+    static LoopKey key_of(const swarm_msgs::LoopConnection & loop) {
+        return LoopKey(loop.id_a, loop.ts_a.toNSec(), loop.id_b, loop.ts_b.toNSec());
+    }
+
+    bool is_consistent(const LoopEntry & li, const LoopEntry & lj) const {
+        Swarm::Pose dpose_a = Swarm::Pose::DeltaPose(li.vo_a, lj.vo_a, true);
+        Swarm::Pose dpose_b = Swarm::Pose::DeltaPose(lj.vo_b, li.vo_b, true);
+        Swarm::Pose cycle = li.rel_pose.inverse() * dpose_a * lj.rel_pose * dpose_b;
+
+        double vo_dis = dpose_a.pos().norm() + dpose_b.pos().norm();
+        double pos_std = 2 * LOOP_POS_STD_0 + LOOP_POS_STD_SLOPE * (li.rel_pose.pos().norm() + lj.rel_pose.pos().norm()) +
+            VO_METER_STD_TRANSLATION * vo_dis;
+        double yaw_std = 2 * LOOP_YAW_STD_0 + LOOP_YAW_STD_SLOPE * (li.rel_pose.pos().norm() + lj.rel_pose.pos().norm()) +
+            VO_METER_STD_ANGLE * vo_dis;
+
+        return cycle.pos().norm() < threshold * pos_std && fabs(wrap_angle(cycle.yaw())) < threshold * yaw_std;
+    }
+
+    static std::vector<int> degrees(const LoopGroup & group) {
+        int n = group.loops.size();
+        std::vector<int> degree(n, 0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                if (i != j && group.consistent[i][j]) {
+                    degree[i] ++;
+                }
+            }
+        }
+        return degree;
+    }
+
+    //Larger set is better; on tie the one with more consistent pairs to all loops, then the one with newer loops
+    static bool better_clique(const std::set<int> & a, const std::set<int> & b, const std::vector<int> & degree) {
+        if (a.size() != b.size()) {
+            return a.size() > b.size();
+        }
+        int support_a = 0, support_b = 0;
+        for (int i : a) {
+            support_a += degree[i];
+        }
+        for (int i : b) {
+            support_b += degree[i];
+        }
+        if (support_a != support_b) {
+            return support_a > support_b;
+        }
+        return !a.empty() && (b.empty() || *a.rbegin() > *b.rbegin());
+    }
+
+    //Heuristic maximum clique: greedy growth from each loop in order of degree, skipping loops which can't beat the best
+    static std::set<int> max_clique(const LoopGroup & group) {
+        int n = group.loops.size();
+        std::vector<int> degree = degrees(group);
+
+        std::set<int> best;
+        for (int i = 0; i < n; i++) {
+            if (degree[i] + 1 < (int) best.size()) {
+                continue;
+            }
+
+            std::vector<int> candidates;
+            for (int j = 0; j < n; j++) {
+                if (j != i && group.consistent[i][j] && degree[j] + 1 >= (int) best.size()) {
+                    candidates.push_back(j);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+                return degree[a] > degree[b];
+            });
+
+            std::set<int> clique{i};
+            for (int j : candidates) {
+                bool consistent_all = true;
+                for (int k : clique) {
+                    if (!group.consistent[j][k]) {
+                        consistent_all = false;
+                        break;
+                    }
+                }
+                if (consistent_all) {
+                    clique.insert(j);
+                }
+            }
+
+            if (better_clique(clique, best, degree)) {
+                best = clique;
+            }
+        }
+        return best;
+    }
+
+    //Remove loop from group only; whether it is an inlier is decided by caller
+    static void drop_loop(LoopGroup & group, int index) {
+        group.loops.erase(group.loops.begin() + index);
+        group.consistent.erase(group.consistent.begin() + index);
+        for (auto & row : group.consistent) {
+            row.erase(row.begin() + index);
+        }
+        std::set<int> clique;
+        for (int i : group.clique) {
+            if (i < index) {
+                clique.insert(i);
+            } else if (i > index) {
+                clique.insert(i - 1);
+            }
+        }
+        group.clique = clique;
+    }
+
+    //Over size cap, the oldest rejected loop goes first. Accepted loops stay accepted when they are evicted,
+    //they are only no longer checked against new loops
+    void drop_for_cap(LoopGroup & group) {
+        int index = 0;
+        for (int i = 0; i < (int) group.loops.size(); i++) {
+            if (group.clique.find(i) == group.clique.end()) {
+                index = i;
+                break;
+            }
+        }
+        drop_loop(group, index);
+    }
+
+    void update_clique(LoopGroup & group, const std::pair<int, int> & ids) {
+        auto clique = max_clique(group);
+        if (better_clique(clique, group.clique, degrees(group))) {
+            ROS_WARN("PCM of loops %d<->%d: consistent set changes, size %ld->%ld", ids.first, ids.second, group.clique.size(), clique.size());
+            group.clique = clique;
+        }
+    }
+
+    void update_inliers(const LoopGroup & group) {
+        for (auto & loop : group.loops) {
+            inliers.erase(loop.key);
+        }
+        for (int i : group.clique) {
+            inliers.insert(group.loops[i].key);
+        }
+    }
+
+public:
+    //threshold is in times of std of cycle error, non positive to disable
+    LoopPCM(double _threshold = 3.0) :
+        threshold(_threshold) {
+    }
+
+    //Return if the loop is in the maximum consistent set after adding it; earlier inliers may be rejected by it.
+    //A loop already in its group is not added again and its current status is returned
+    bool add_loop(const swarm_msgs::LoopConnection & loop) {
+        LoopKey key = key_of(loop);
+        if (threshold <= 0) {
+            inliers.insert(key);
+            return true;
+        }
+
+        Swarm::LoopConnection loc(loop);
+        LoopEntry entry;
+        entry.key = key;
+        entry.vo_a = loc.self_pose_a;
+        entry.vo_b = loc.self_pose_b;
+        entry.rel_pose = loc.relative_pose;
+        int id_a = loop.id_a, id_b = loop.id_b;
+        if (id_a > id_b) {
+            std::swap(id_a, id_b);
+            std::swap(entry.vo_a, entry.vo_b);
+            entry.rel_pose = entry.rel_pose.inverse();
+        }
+
+        auto ids = std::make_pair(id_a, id_b);
+        auto & group = groups[ids];
+        //Same loop may arrive again, e.g. found locally and relayed by a neighbour; a copy is trivially consistent with it
+        LoopKey key_swapped(loop.id_b, loop.ts_b.toNSec(), loop.id_a, loop.ts_a.toNSec());
+        for (int i = 0; i < (int) group.loops.size(); i++) {
+            if (group.loops[i].key == key || group.loops[i].key == key_swapped) {
+                return group.clique.find(i) != group.clique.end();
+            }
+        }
+
+        if (group.loops.size() >= PCM_MAX_GROUP_SIZE) {
+            drop_for_cap(group);
+        }
+
+        int index = group.loops.size();
+        group.loops.push_back(entry);
+        bool consistent_clique = true;
+        for (int i = 0; i < index; i++) {
+            bool c = is_consistent(group.loops[i], entry);
+            group.consistent[i].push_back(c);
+            if (!c && group.clique.find(i) != group.clique.end()) {
+                consistent_clique = false;
+            }
+        }
+        group.consistent.push_back(std::vector<bool>(index + 1, true));
+        for (int i = 0; i < index; i++) {
+            group.consistent[index][i] = group.consistent[i][index];
+        }
+
+        if (consistent_clique) {
+            group.clique.insert(index);
+        } else {
+            update_clique(group, ids);
+        }
+
+        update_inliers(group);
+        return group.clique.find(index) != group.clique.end();
+    }
+
+    //Evict loops whose ts_a is before ts, i.e. they left sliding window, and search consistent sets again without them
+    void drop_before(int64_t ts) {
+        for (auto it = inliers.begin(); it != inliers.end();) {
+            if (std::get<1>(*it) < ts) {
+                it = inliers.erase(it);
+            } else {
+                it++;
+            }
+        }
+
+        for (auto & it : groups) {
+            auto & group = it.second;
+            bool dropped = false;
+            for (int i = group.loops.size() - 1; i >= 0; i--) {
+                if (std::get<1>(group.loops[i].key) < ts) {
+                    drop_loop(group, i);
+                    dropped = true;
+                }
+            }
+            if (dropped) {
+                update_clique(group, it.first);
+                update_inliers(group);
+            }
+        }
+    }
+
+    bool is_inlier(const swarm_msgs::LoopConnection & loop) const {
+        return inliers.find(key_of(loop)) != inliers.end();
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <swarm_msgs/swarm_types.hpp>
+
+//Plain copy of the pose graph in sliding window, cheap to take at end of solve
+struct PoseGraphSnapshot {
+    enum EdgeType {
+        VIO = 0,
+        Distance = 1,
+        FrameDetection = 2,
+        Loop = 3,
+        Detection = 4
+    };
+
+    struct Vertex {
+        int64_t ts;
+        int id;
+        Swarm::Pose pose;
+    };
+
+    struct Edge {
+        int type;
+        int64_t ts_a;
+        int id_a;
+        int64_t ts_b;
+        int id_b;
+        //Relative pose for VIO and loop edges, distance for distance edges
+        Swarm::Pose rel_pose;
+        double distance = 0;
+    };
+
+    std::vector<int64_t> frames;
+    std::vector<Vertex> vertices;
+    std::vector<Edge> edges;
+};
+
+//Write pose graph snapshots in background; only the newest pending snapshot is kept
+class PoseGraphExporter {
+    std::thread th;
+    std::mutex lock;
+    std::condition_variable cv;
+    PoseGraphSnapshot pending;
+    bool has_pending = false;
+    bool running = true;
+
+    std::string dot_path;
+    std::string base_path;
+    bool export_dot = true;
+    bool export_binary = false;
+    bool export_g2o = false;
+
+    void worker();
+
+    void write_dot(const PoseGraphSnapshot & snapshot, const std::string & path) const;
+    void write_binary(const PoseGraphSnapshot & snapshot, const std::string & path) const;
+    void write_g2o(const PoseGraphSnapshot & snapshot, const std::string & path) const;
+
+public:
+    //formats is comma separated list of dot, bin and g2o
+    PoseGraphExporter(const std::string & _dot_path, const std::string & formats);
+    ~PoseGraphExporter();
+
+    void submit(PoseGraphSnapshot && snapshot);
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <cstring>
+#include "ros/ros.h"
+#include <ros/serialization.h>
+#include <swarm_msgs/swarm_frame.h>
+#include <swarm_msgs/LoopConnection.h>
+#include <swarm_msgs/node_detected_xyzyaw.h>
+#include <swarm_msgs/swarm_types.hpp>
+
+#define CHECKPOINT_MAGIC "SLC1"
+//Sane maxima for a checkpoint read, a broken or foreign file is rejected instead of allocating by its counts
+#define CHECKPOINT_MAX_COUNT 100000
+#define CHECKPOINT_MAX_MSG_SIZE (16*1024*1024)
+#define CHECKPOINT_POSE_SIZE (sizeof(int64_t) + sizeof(int32_t) + 4*sizeof(double))
+
+//Checkpoint of solver for warm restart. Keyframes and accepted measurements in window are kept as raw messages, so restore goes through same conversion as online
+//Layout: "SLC1" int64 wall_stamp_ns int32 self_id, then frames, poses, loops and detections each prefixed by uint32 count;
+//messages are stored as uint32 length + ros serialized bytes, poses as int64 ts int32 id double x y z yaw
+struct SolverCheckpoint {
+    int64_t stamp = 0;
+    int self_id = -1;
+    std::vector<swarm_msgs::swarm_frame> keyframes;
+    std::map<int64_t, std::map<int, Swarm::Pose>> poses;
+    std::vector<swarm_msgs::LoopConnection> loops;
+    std::vector<swarm_msgs::node_detected_xyzyaw> detections;
+
+    template<typename T>
+    static bool write_msg(FILE * f, const T & msg) {
+        uint32_t size = ros::serialization::serializationLength(msg);
+        std::vector<uint8_t> buf(size);
+        ros::serialization::OStream stream(buf.data(), size);
+        ros::serialization::serialize(stream, msg);
+        return fwrite(&size, sizeof(uint32_t), 1, f) == 1 &&
+            fwrite(buf.data(), 1, size, f) == size;
+    }
+
+    //Bytes left from current position to end of file
+    static long remaining(FILE * f) {
+        long pos = ftell(f);
+        fseek(f, 0, SEEK_END);
+        long end = ftell(f);
+        fseek(f, pos, SEEK_SET);
+        return end - pos;
+    }
+
+    template<typename T>
+    static bool read_msg(FILE * f, T & msg) {
+        uint32_t size = 0;
+        if (fread(&size, sizeof(uint32_t), 1, f) != 1 || size > CHECKPOINT_MAX_MSG_SIZE || (long) size > remaining(f)) {
+            return false;
+        }
+        std::vector<uint8_t> buf(size);
+        if (fread(buf.data(), 1, size, f) != size) {
+            return false;
+        }
+        try {
+            ros::serialization::IStream stream(buf.data(), size);
+            ros::serialization::deserialize(stream, msg);
+        } catch (const ros::Exception & e) {
+            ROS_WARN("Broken message in checkpoint: %s", e.what());
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    static bool write_msgs(FILE * f, const std::vector<T> & msgs) {
+        uint32_t num = msgs.size();
+        if (fwrite(&num, sizeof(uint32_t), 1, f) != 1) {
+            return false;
+        }
+        for (auto & msg : msgs) {
+            if (!write_msg(f, msg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename T>
+    static bool read_msgs(FILE * f, std::vector<T> & msgs) {
+        uint32_t num = 0;
+        //Each message takes at least its length field
+        if (fread(&num, sizeof(uint32_t), 1, f) != 1 || num > CHECKPOINT_MAX_COUNT || (long) (num * sizeof(uint32_t)) > remaining(f)) {
+            return false;
+        }
+        msgs.resize(num);
+        for (auto & msg : msgs) {
+            if (!read_msg(f, msg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //Write to a temporary file and rename, so a crash or write error (e.g. full disk) never leaves a broken checkpoint
+    bool write(const std::string & path) const {
+        std::string tmp_path = path + ".tmp";
+        FILE * f = fopen(tmp_path.c_str(), "wb");
+        if (f == nullptr) {
+            ROS_WARN("Unable to open %s for checkpoint", tmp_path.c_str());
+            return false;
+        }
+
+        int32_t _self_id = self_id;
+        bool success = fwrite(CHECKPOINT_MAGIC, 1, 4, f) == 4 &&
+            fwrite(&stamp, sizeof(int64_t), 1, f) == 1 &&
+            fwrite(&_self_id, sizeof(int32_t), 1, f) == 1 &&
+            write_msgs(f, keyframes);
+
+        uint32_t pose_num = 0;
+        for (auto & it : poses) {
+            pose_num += it.second.size();
+        }
+        success = success && fwrite(&pose_num, sizeof(uint32_t), 1, f) == 1;
+        for (auto & it : poses) {
+            for (auto & it2 : it.second) {
+                if (!success) {
+                    break;
+                }
+                int32_t _id = it2.first;
+                Swarm::Pose _pose = it2.second;
+                double pose[4];
+                _pose.to_vector_xyzyaw(pose);
+                success = fwrite(&it.first, sizeof(int64_t), 1, f) == 1 &&
+                    fwrite(&_id, sizeof(int32_t), 1, f) == 1 &&
+                    fwrite(pose, sizeof(double), 4, f) == 4;
+            }
+        }
+
+        success = success && write_msgs(f, loops) && write_msgs(f, detections);
+        //Buffered data is flushed on close, which can fail as well
+        success = (fclose(f) == 0) && success;
+        if (!success) {
+            ROS_WARN("Failed to write checkpoint %s", tmp_path.c_str());
+            remove(tmp_path.c_str());
+            return false;
+        }
+        return rename(tmp_path.c_str(), path.c_str()) == 0;
+    }
+
+    bool read(const std::string & path) {
+        FILE * f = fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+
+        char magic[4] = {0};
+        int32_t _self_id = -1;
+        bool success = fread(magic, 1, 4, f) == 4 && strncmp(magic, CHECKPOINT_MAGIC, 4) == 0 &&
+            fread(&stamp, sizeof(int64_t), 1, f) == 1 &&
+            fread(&_self_id, sizeof(int32_t), 1, f) == 1 &&
+            read_msgs(f, keyframes);
+        self_id = _self_id;
+
+        uint32_t pose_num = 0;
+        success = success && fread(&pose_num, sizeof(uint32_t), 1, f) == 1 &&
+            pose_num <= CHECKPOINT_MAX_COUNT && (long) (pose_num * CHECKPOINT_POSE_SIZE) <= remaining(f);
+        for (uint32_t i = 0; success && i < pose_num; i++) {
+            int64_t ts;
+            int32_t _id;
+            double pose[4];
+            success = fread(&ts, sizeof(int64_t), 1, f) == 1 &&
+                fread(&_id, sizeof(int32_t), 1, f) == 1 &&
+                fread(pose, sizeof(double), 4, f) == 4;
+            if (success) {
+                poses[ts][_id] = Swarm::Pose(pose, true);
+            }
+        }
+
+        success = success && read_msgs(f, loops) && read_msgs(f, detections) && remaining(f) == 0;
+        fclose(f);
+        if (!success) {
+            ROS_WARN("Checkpoint %s is broken", path.c_str());
+        }
+        return success;
+    }
+};
@@ -0,0 +1,836 @@
+#pragma once
+#include <iostream>
+#include "glog/logging.h"
+#include <eigen3/Eigen/Dense>
+#include "ceres/ceres.h"
+#include <vector>
+#include "ros/ros.h"
+#include <swarm_msgs/swarm_frame.h>
+#include <swarm_msgs/node_frame.h>
+#include <algorithm>
+#include <set>
+#include <map>
+#include <ctime>
+#include <thread>
+#include <unistd.h>
+#include "swarm_localization/swarm_localization_solver.hpp"
+#include "swarm_msgs/swarm_fused.h"
+#include "swarm_msgs/swarm_fused_relative.h"
+#include <geometry_msgs/Point.h>
+#include <geometry_msgs/Vector3.h>
+#include "yaml-cpp/yaml.h"
+#include <nav_msgs/Odometry.h>
+#include <std_msgs/Float32.h>
+#include <chrono>
+#include <swarm_msgs/swarm_drone_basecoor.h>
+#include <swarm_msgs/LoopConnection.h>
+#include <swarm_msgs/swarm_detected.h>
+#include <nav_msgs/Path.h>
+#include "swarm_localization/swarm_localization_params.hpp"
+#include "swarm_localization/swarm_msg_convert.hpp"
+#include "swarm_localization/solver_checkpoint.hpp"
+#include "swarm_localization/anchor_predictor.hpp"
+#include <swarm_localization/SwarmPathSnapshot.h>
+#include <swarm_localization/SwarmFactorStats.h>
+#include <swarm_localization/SwarmPathDelta.h>
+#include <mutex>
+#include <future>
+
+using ceres::CostFunction;
+using ceres::Problem;
+using ceres::Solver;
+using ceres::Solve;
+using ceres::SizedCostFunction;
+using ceres::Covariance;
+
+using namespace Eigen;
+using namespace nav_msgs;
+using namespace swarm_msgs;
+using namespace std::chrono;
+
+#define PATH_DELTA_POS_THRES 0.01
+#define PATH_DELTA_YAW_THRES 0.01
+
+//Only confident base coordinates of neighbors are used for warm start and as boundary in decentralized mode
+#define WARM_START_MAX_POS_COV 1.0
+#define WARM_START_MAX_YAW_COV 0.1
+
+
+class SwarmLocalizationNode {
+
+    void add_drone_id(int _id) {
+        this->remote_ids_arr.push_back(_id);
+        this->remote_ids_set.insert(_id);
+        this->ids_index_in_arr[_id] = this->remote_ids_arr.size() - 1;
+    }
+
+    bool has_this_drone(int _id) {
+        return remote_ids_set.find(_id) != remote_ids_set.end();
+    }
+
+
+    bool nodedef_has_id(int _id) const {
+        return all_node_defs.find(_id) != all_node_defs.end();
+    }
+
+    NodeFrame node_frame_from_msg(const swarm_msgs::node_frame &_nf) const {
+        return ::node_frame_from_msg(all_node_defs, _nf);
+    }
+
+    SwarmFrame swarm_frame_from_msg(const swarm_msgs::swarm_frame &_sf) const {
+        return ::swarm_frame_from_msg(all_node_defs, _sf);
+    }
+
+
+    void on_loop_connection_received(const swarm_msgs::LoopConnection & loop_conn) {
+        ROS_INFO("Add new loop connection from %d to %d", loop_conn.id_a, loop_conn.id_b);
+        this->swarm_localization_solver->add_new_loop_connection(loop_conn);
+    }
+
+    double t_last = 0;
+protected:
+    void on_swarm_detected(const swarm_msgs::node_detected_xyzyaw & sd) {
+        ROS_INFO("Add new detector from %d to %d", sd.self_drone_id, sd.remote_drone_id);
+        this->swarm_localization_solver->add_new_detection(sd);
+    }
+
+    void on_swarmframe_recv(const ros::MessageEvent<swarm_msgs::swarm_frame const> & event) {
+        const swarm_msgs::swarm_frame & _sf = *event.getMessage();
+        SwarmFrame sf = swarm_frame_from_msg(_sf);
+
+        int _self_id = _sf.self_id;
+        frame_id = "world";
+
+        swarm_localization_solver->self_id = _self_id;
+
+        if (remote_ids_arr.empty()) {
+            //This is first time of receive data
+            this->self_id = _self_id;
+            swarm_localization_solver->self_id = self_id;
+            ROS_INFO("self id %d", self_id);
+            add_drone_id(self_id);
+        }
+
+        for (int _id: sf.node_id_list) {
+            if (!has_this_drone(_id))
+                add_drone_id(_id);
+        }
+
+        double t_now = _sf.header.stamp.toSec();
+
+        if (offload_mode == "follower" && !failover) {
+            return;
+        }
+
+        //Follower with failover keeps its window filled, so it can take over once leader goes silent
+        swarm_localization_solver->add_new_swarm_frame(sf);
+        if (!checkpoint_path.empty()) {
+            keep_keyframe_msg(_sf, sf.ts);
+        }
+        // printf("Tnow %f DT %f\n", t_now, t_now - t_last);
+        // For some bags if (t_now - t_last > 1 / force_freq && (t_now - t_last < 10 || t_last <1e-4)) {
+        //Solve interval is stretched together with keyframe movement when solver is overloaded
+        if (is_solving() && t_now - t_last > swarm_localization_solver->load_scale() / force_freq) {// && (t_now - t_last < 10 || t_last <1e-4)) {
+            std_msgs::Float32 cost;
+            // ROS_INFO("Try to solve");
+            std::lock_guard<std::mutex> guard(solve_lock);
+            auto solve_start = ros::WallTime::now();
+            cost.data = this->swarm_localization_solver->solve();
+            //Ingest lag is time the frame waited since it arrived, stamps of frames are not comparable to now in replay
+            swarm_localization_solver->update_load((ros::WallTime::now() - solve_start).toSec(),
+                (ros::Time::now() - event.getReceiptTime()).toSec(), 1 / force_freq);
+            t_last = t_now;
+            if (cost.data >= 0) {
+                solving_cost_pub.publish(cost);
+                pub_full_path();
+                pub_factor_stats(_sf.header.stamp);
+                if (!checkpoint_path.empty() && (ros::WallTime::now() - last_checkpoint_time).toSec() > checkpoint_interval) {
+                    write_checkpoint();
+                }
+            }
+        }
+    }
+
+    nav_msgs::Path to_ros_path(const Swarm::Path & path) const {
+        nav_msgs::Path _path;
+        _path.header.frame_id = "world";
+
+        for (auto & pose_stamped: path) {
+            auto & pose = pose_stamped.second;
+            geometry_msgs::PoseStamped _pose_stamped;
+            _pose_stamped.header.stamp.fromNSec(pose_stamped.first);
+            _pose_stamped.header.frame_id = "world";
+            _path.header.stamp = _pose_stamped.header.stamp;
+            _pose_stamped.pose = pose.to_ros_pose();
+            _path.poses.push_back(_pose_stamped);
+        }
+        return _path;
+    }
+
+    //Temporal and spatial decimation of path, the newest pose is always kept
+    //A pose is kept once time or distance since last kept pose exceeds its threshold; threshold <= 0 is disabled
+    Swarm::Path decimate_path(const Swarm::Path & path) const {
+        if (path_decimate_dt <= 0 && path_decimate_distance <= 0) {
+            return path;
+        }
+
+        Swarm::Path ret(0);
+        for (unsigned int i = 0; i < path.size(); i++) {
+            if (!ret.empty() && i < path.size() - 1) {
+                auto & last = ret.back();
+                double dt = (path[i].first - last.first)/1e9;
+                double dis = (path[i].second.pos() - last.second.pos()).norm();
+                bool dt_exceeded = path_decimate_dt > 0 && dt >= path_decimate_dt;
+                bool dis_exceeded = path_decimate_distance > 0 && dis >= path_decimate_distance;
+                if (!dt_exceeded && !dis_exceeded) {
+                    continue;
+                }
+            }
+            ret.push_back(path[i]);
+        }
+        return ret;
+    }
+
+    //Poses which are new or moved since last delta of this drone, and stamps of poses which are gone
+    //Returns false when nothing changed
+    bool delta_path(int id, const Swarm::Path & path, swarm_localization::SwarmPathDelta & delta) {
+        Swarm::Path changed(0);
+        auto & published = published_pathes[id];
+        std::map<int64_t, Pose> now_published;
+        for (auto & pose_stamped : path) {
+            auto it = published.find(pose_stamped.first);
+            if (it == published.end() || 
+                (it->second.pos() - pose_stamped.second.pos()).norm() > PATH_DELTA_POS_THRES ||
+                fabs(wrap_angle(it->second.yaw() - pose_stamped.second.yaw())) > PATH_DELTA_YAW_THRES) {
+                changed.push_back(pose_stamped);
+                now_published[pose_stamped.first] = pose_stamped.second;
+            } else {
+                now_published[pose_stamped.first] = it->second;
+            }
+        }
+
+        delta.removed.clear();
+        for (auto & it : published) {
+            if (now_published.find(it.first) == now_published.end()) {
+                ros::Time stamp;
+                stamp.fromNSec(it.first);
+                delta.removed.push_back(stamp);
+            }
+        }
+        published = now_published;
+
+        if (changed.empty() && delta.removed.empty()) {
+            return false;
+        }
+        delta.id = id;
+        delta.seq = path_delta_seqs[id]++;
+        delta.path = to_ros_path(changed);
+        if (!path.empty()) {
+            delta.header.stamp.fromNSec(path.back().first);
+        }
+        delta.header.frame_id = "world";
+        return true;
+    }
+
+    ros::Publisher & path_publisher(int id, bool delta) {
+        auto & pubs = delta ? pathes_delta_pubs : pathes_pubs;
+        if (pubs.find(id) == pubs.end()) {
+            char name[100] = {0};
+            sprintf(name, "/swarm_drones/est_drone_%d_path%s%s", id, delta ? "_delta" : "", is_pc_replay ? "_pc" : "");
+            if (delta) {
+                pubs[id] = nh.advertise<swarm_localization::SwarmPathDelta>(name, 100);
+            } else {
+                pubs[id] = nh.advertise<nav_msgs::Path>(name, 1);
+            }
+        }
+        return pubs[id];
+    }
+
+    const std::map<int, Swarm::Path> & solved_pathes() const {
+        if (publish_full_path) {
+            return swarm_localization_solver->full_pathes;
+        }
+        return swarm_localization_solver->kf_pathes;
+    }
+
+    void pub_full_path() {
+        for (auto & it: solved_pathes()) {
+            auto id = it.first;
+            auto path = decimate_path(it.second);
+
+            if (path_publish_delta) {
+                swarm_localization::SwarmPathDelta delta;
+                if (delta_path(id, path, delta)) {
+                    path_publisher(id, true).publish(delta);
+                }
+            }
+
+            //Full path is still published in delta mode, but only built when someone listens
+            auto & full_pub = path_publisher(id, false);
+            if (!path_publish_delta || full_pub.getNumSubscribers() > 0) {
+                full_pub.publish(to_ros_path(path));
+            }
+        }
+    }
+
+    bool on_path_snapshot_request(swarm_localization::SwarmPathSnapshot::Request & req, 
+            swarm_localization::SwarmPathSnapshot::Response & res) {
+        std::lock_guard<std::mutex> guard(solve_lock);
+        std::set<int> ids(req.ids.begin(), req.ids.end());
+        for (auto & it: solved_pathes()) {
+            if (!ids.empty() && ids.find(it.first) == ids.end()) {
+                continue;
+            }
+            res.ids.push_back(it.first);
+            res.pathes.push_back(to_ros_path(it.second));
+        }
+        return true;
+    }
+
+    //Raw messages of keyframes in sliding window, which are saved in checkpoint
+    void keep_keyframe_msg(const swarm_msgs::swarm_frame & _sf, int64_t ts) {
+        auto kf_ts = swarm_localization_solver->keyframe_ts();
+        if (kf_ts.empty() || kf_ts.back() != ts) {
+            return;
+        }
+        keyframe_msgs[ts] = _sf;
+        std::set<int64_t> kf_set(kf_ts.begin(), kf_ts.end());
+        for (auto it = keyframe_msgs.begin(); it != keyframe_msgs.end();) {
+            if (kf_set.find(it->first) == kf_set.end()) {
+                it = keyframe_msgs.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    //Checkpoint is collected with solve lock held and written to disk on another thread
+    void write_checkpoint() {
+        if (!swarm_localization_solver->CanPredictSwarm()) {
+            return;
+        }
+        if (checkpoint_writing.valid() && checkpoint_writing.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            //Last checkpoint is still being written
+            return;
+        }
+        auto checkpoint = std::make_shared<SolverCheckpoint>();
+        checkpoint->stamp = ros::WallTime::now().toNSec();
+        checkpoint->self_id = self_id;
+        for (auto ts : swarm_localization_solver->keyframe_ts()) {
+            if (keyframe_msgs.find(ts) != keyframe_msgs.end()) {
+                checkpoint->keyframes.push_back(keyframe_msgs.at(ts));
+            }
+        }
+        checkpoint->poses = swarm_localization_solver->keyframe_poses();
+        checkpoint->loops = swarm_localization_solver->window_loop_connections();
+        checkpoint->detections = swarm_localization_solver->window_detections();
+        last_checkpoint_time = ros::WallTime::now();
+        std::string path = checkpoint_path;
+        checkpoint_writing = std::async(std::launch::async, [checkpoint, path]() {
+            return checkpoint->write(path);
+        });
+    }
+
+    void restore_checkpoint() {
+        SolverCheckpoint checkpoint;
+        if (!checkpoint.read(checkpoint_path)) {
+            ROS_INFO("No valid checkpoint at %s", checkpoint_path.c_str());
+            return;
+        }
+
+        double age = (ros::WallTime::now().toNSec() - checkpoint.stamp) / 1e9;
+        if (age > checkpoint_max_age || checkpoint.keyframes.empty()) {
+            ROS_WARN("Checkpoint at %s is %.1fs old, not used", checkpoint_path.c_str(), age);
+            return;
+        }
+
+        self_id = checkpoint.self_id;
+        swarm_localization_solver->self_id = self_id;
+        add_drone_id(self_id);
+        std::vector<SwarmFrame> keyframes;
+        for (auto & _sf : checkpoint.keyframes) {
+            keyframes.push_back(swarm_frame_from_msg(_sf));
+            keyframe_msgs[keyframes.back().ts] = _sf;
+            for (int _id : keyframes.back().node_id_list) {
+                if (!has_this_drone(_id)) {
+                    add_drone_id(_id);
+                }
+            }
+        }
+        swarm_localization_solver->restore(keyframes, checkpoint.poses, checkpoint.loops, checkpoint.detections);
+        ROS_INFO("Warm restart from checkpoint %s of %.1fs old, self id %d", checkpoint_path.c_str(), age, self_id);
+    }
+
+    void pub_factor_stats(ros::Time stamp) {
+        auto & factor_stats = swarm_localization_solver->factor_stats;
+        if (factor_stats.empty() || factor_stats_pub.getNumSubscribers() == 0) {
+            return;
+        }
+        swarm_localization::SwarmFactorStats msg;
+        msg.header.stamp = stamp;
+        for (auto & it : factor_stats) {
+            auto & stats = it.second;
+            msg.types.push_back(FactorStats::type_name(stats.type));
+            msg.id_a.push_back(stats.id_a);
+            msg.id_b.push_back(stats.id_b);
+            msg.counts.push_back(stats.count);
+            msg.costs.push_back(stats.cost);
+            msg.mean_errors.push_back(stats.error_mean());
+            msg.max_errors.push_back(stats.error_max);
+            msg.mean_weights.push_back(stats.weight_mean());
+            msg.downweighted.push_back(stats.downweighted);
+        }
+        factor_stats_pub.publish(msg);
+    }
+
+    void on_remote_basecoor_recv(const swarm_drone_basecoor & msg) {
+        if (msg.self_id == self_id) {
+            return;
+        }
+
+        if (offload_mode == "follower" && leader_ids.find(msg.self_id) != leader_ids.end()) {
+            std::lock_guard<std::mutex> guard(anchor_lock);
+            anchor_predictor.on_anchors_recv(msg, leader_timeout);
+        }
+
+        if (!cooperative_init && !swarm_localization_solver->is_decentralized()) {
+            return;
+        }
+
+        BaseCoors coors;
+        for (unsigned int i = 0; i < msg.ids.size(); i++) {
+            if (msg.position_cov[i].x > WARM_START_MAX_POS_COV || msg.position_cov[i].y > WARM_START_MAX_POS_COV ||
+                msg.position_cov[i].z > WARM_START_MAX_POS_COV || msg.yaw_cov[i] > WARM_START_MAX_YAW_COV) {
+                continue;
+            }
+            coors[msg.ids[i]] = Pose(msg.drone_basecoor[i], msg.drone_baseyaw[i]);
+        }
+
+        std::lock_guard<std::mutex> guard(solve_lock);
+        swarm_localization_solver->add_neighbor_basecoor(msg.self_id, msg.header.stamp, coors);
+    }
+
+    void pub_posevel_id(unsigned int id, const Pose & pose, const Eigen::Matrix4d cov, const Eigen::Vector3d vel, ros::Time stamp) {
+        Odometry odom;
+        odom.header.stamp = stamp;
+        odom.header.frame_id = "world";
+        odom.pose.pose = pose.to_ros_pose();
+        odom.twist.twist.linear.x = vel.x();
+        odom.twist.twist.linear.y = vel.y();
+        odom.twist.twist.linear.z = vel.z();
+        // for (int i = 0; i < 4; i++) {
+            // for (int j =0; j < 4; j++) {
+                // odom.pose.covariance[i*6+j] = cov(i, j);
+            // }
+        // }
+        pub_odom_id(id, odom);
+    }
+
+    void pub_odom_id(unsigned int id, const Odometry &odom) {
+        if (remote_drone_odom_pubs.find(id) == remote_drone_odom_pubs.end()) {
+            char name[100] = {0};
+            if (is_pc_replay) {
+                sprintf(name, "/swarm_drones/est_drone_%d_odom_pc", id);
+            } else {
+                sprintf(name, "/swarm_drones/est_drone_%d_odom", id);
+            }
+            remote_drone_odom_pubs[id] = nh.advertise<Odometry>(name, 1);
+        }
+
+        auto pub = remote_drone_odom_pubs[id];
+
+        pub.publish(odom);
+    }
+
+    float force_freq = 10;
+    ros::NodeHandle &nh;
+
+private:
+
+    ros::Subscriber recv_sf_est, recv_sf_predict;
+    ros::Subscriber recv_drone_odom_now;
+    ros::Subscriber loop_connection_sub;
+    ros::Subscriber swarm_detected_sub;
+    ros::Subscriber remote_basecoor_sub;
+    bool cooperative_init = false;
+
+    //Compute offload: leader solves and its base coordinates reach followers through localization_proxy as anchors,
+    //follower predicts by them
+    std::string offload_mode;
+    float leader_timeout = 3.0;
+    std::set<int> leader_ids;
+    bool failover = true;
+    bool failover_solving = true;
+    AnchorPredictor anchor_predictor;
+    std::mutex anchor_lock;
+    ros::Publisher fused_drone_data_pub, fused_drone_basecoor_pub, solving_cost_pub, fused_drone_rel_data_pub;
+    ros::Publisher factor_stats_pub;
+
+    std::string frame_id = "";
+
+    std::map<int, ros::Publisher> remote_drone_odom_pubs;
+    std::map<int, ros::Publisher> pathes_pubs;
+    std::map<int, ros::Publisher> pathes_delta_pubs;
+    std::map<int, std::map<int64_t, Pose>> published_pathes;
+    std::map<int, uint32_t> path_delta_seqs;
+    std::map<int64_t, swarm_msgs::swarm_frame> keyframe_msgs;
+    std::string checkpoint_path;
+    float checkpoint_interval = 5.0;
+    float checkpoint_max_age = 30.0;
+    ros::WallTime last_checkpoint_time;
+    std::future<bool> checkpoint_writing;
+    ros::ServiceServer path_snapshot_srv;
+    std::mutex solve_lock;
+    SwarmLocalizationSolver *swarm_localization_solver = nullptr;
+
+    std::vector<int> remote_ids_arr;
+    std::set<int> remote_ids_set;
+    std::map<int, int> ids_index_in_arr;
+    std::map<int, Node *> all_node_defs;
+
+    ros::Timer timer;
+
+    bool pub_swarm_odom = false;
+    bool publish_full_path = false;
+    bool path_publish_delta = false;
+    float path_decimate_dt = 0;
+    float path_decimate_distance = 0;
+    bool is_pc_replay = false;
+
+
+    int self_id = -1;
+
+    float predict_freq;
+
+    void load_nodes_from_file(const std::string &path) {
+        try {
+            ROS_INFO("Loading swarmconfig from %s", path.c_str());
+            YAML::Node nodes_config = YAML::LoadFile(path)["nodes"];
+            for(YAML::iterator it=nodes_config.begin();it!=nodes_config.end();++it) {
+                    int node_id = it->first.as<int>();
+                    const YAML::Node & _node_config = it->second;
+                    ROS_INFO("Parsing node %d", node_id);
+                    Node *new_node = new Node(node_id, _node_config);
+                    all_node_defs[node_id] = new_node;
+                    auto ann_pos = new_node->get_anntena_pos();
+                    ROS_INFO("NODE %d static:%d vo %d uwb %d ann %5.4f %5.4f %5.4f",
+                             new_node->id,
+                             new_node->is_static_node(),
+                             new_node->has_odometry(),
+                             new_node->has_uwb(),
+                             ann_pos.x(),
+                             ann_pos.y(),
+                             ann_pos.z()
+                    );
+                    
+                }
+
+        } catch (std::exception & e) {
+            ROS_ERROR("Error while parsing config file:%s, exit",e.what());
+            exit(-1);
+        }
+
+    }
+
+    void pub_zero_base_coor(ros::Time stamp) {
+        //Publish by shared pointer, so nodelets in same manager receive it without serialization
+        auto sdb_ptr = boost::make_shared<swarm_drone_basecoor>();
+        auto & sdb = *sdb_ptr;
+        sdb.header.stamp = stamp;
+        sdb.ids.push_back(self_id);
+        geometry_msgs::Point pt;
+        pt.x = 0;
+        pt.y = 0;
+        pt.z = 0;
+        geometry_msgs::Vector3 pcov;
+        pcov.x = 0;
+        pcov.y = 0;
+        pcov.z = 0;
+
+        sdb.drone_basecoor.push_back(pt);
+        sdb.position_cov.push_back(pcov);
+        sdb.drone_baseyaw.push_back(0);
+        sdb.yaw_cov.push_back(0);
+        sdb.self_id = self_id;
+        fused_drone_basecoor_pub.publish(sdb_ptr);
+    }
+
+    void pub_fused_relative(const SwarmFrameState & _sfs, ros::Time stamp) {
+        if (_sfs.node_poses.size() < 1) {
+            return;
+        } 
+        auto sfr_ptr = boost::make_shared<swarm_fused_relative>();
+        auto sf_ptr = boost::make_shared<swarm_fused>();
+        auto sdb_ptr = boost::make_shared<swarm_drone_basecoor>();
+        auto & sfr = *sfr_ptr;
+        auto & sf = *sf_ptr;
+        auto & sdb = *sdb_ptr;
+
+        sf.header.stamp = stamp;
+        sfr.header.stamp = stamp;
+        sdb.header.stamp = stamp;
+        sdb.self_id = self_id;
+        Pose self_pose = _sfs.node_poses.at(self_id);
+
+        sf.self_yaw = self_pose.yaw();
+        sf.self_pos = self_pose.to_ros_pose().position;
+        sfr.self_yaw = self_pose.yaw();
+        sfr.self_pos = self_pose.to_ros_pose().position;
+
+        for (auto it : _sfs.node_poses) {
+            int id = it.first;
+            Pose _pose = it.second;
+            Pose DPose = Pose::DeltaPose(self_pose, _pose, true);
+
+            double dyaw = DPose.yaw();
+            sfr.ids.push_back(id);
+            sfr.relative_drone_position.push_back(DPose.to_ros_pose().position);
+            sfr.relative_drone_yaw.push_back(dyaw);
+
+            sf.ids.push_back(id);
+            sf.local_drone_position.push_back(_pose.to_ros_pose().position);
+            sf.local_drone_yaw.push_back(_pose.yaw());
+
+            geometry_msgs::Vector3 pcov;
+            pcov.x = _sfs.node_covs.at(id)(0, 0);
+            pcov.y = _sfs.node_covs.at(id)(1, 1);
+            pcov.z = _sfs.node_covs.at(id)(2, 2);
+            sf.position_cov.push_back(pcov);
+            sf.yaw_cov.push_back(_sfs.node_covs.at(id)(3,3));
+
+            sfr.position_cov.push_back(pcov);
+            sfr.yaw_cov.push_back(_sfs.node_covs.at(id)(3,3));
+
+            //Temp disable veloctiy
+            geometry_msgs::Vector3 spd;
+            spd.x = 0;
+            spd.y = 0;
+            spd.z = 0;
+            sfr.relative_drone_velocity.push_back(spd);
+            sf.local_drone_velocity.push_back(spd);
+
+            sdb.ids.push_back(id);
+            Pose _coor = _sfs.base_coor_poses.at(id);
+            sdb.drone_basecoor.push_back(_coor.to_ros_pose().position);
+            sdb.drone_baseyaw.push_back(_coor.yaw());
+            geometry_msgs::Vector3 pcov2;
+            pcov2.x = _sfs.base_coor_covs.at(id)(0, 0);
+            pcov2.y = _sfs.base_coor_covs.at(id)(1, 1);
+            pcov2.z = _sfs.base_coor_covs.at(id)(2, 2);
+            sdb.position_cov.push_back(pcov2);
+            sdb.yaw_cov.push_back(_sfs.base_coor_covs.at(id)(3,3));
+        }
+
+        fused_drone_rel_data_pub.publish(sfr_ptr);
+        fused_drone_data_pub.publish(sf_ptr);
+        fused_drone_basecoor_pub.publish(sdb_ptr);
+    }
+
+    //Follower only solves when its leader goes silent
+    bool is_solving() {
+        if (offload_mode != "follower") {
+            return true;
+        }
+        std::lock_guard<std::mutex> guard(anchor_lock);
+        bool alive = anchor_predictor.leader_alive(leader_timeout);
+        if (alive == failover_solving) {
+            if (alive) {
+                ROS_INFO("Leader %d is back, stop solving", anchor_predictor.leader());
+            } else {
+                ROS_WARN("Leader silent for %.1fs, take over solving", leader_timeout);
+            }
+        }
+        failover_solving = !alive;
+        return !alive;
+    }
+
+
+
+    double t_last_predict_swarm = 0;
+
+    void predict_swarm(const swarm_frame &_sf) {
+        double t_now = ros::Time::now().toSec();
+        if (t_now - t_last_predict_swarm > 1.0/predict_freq) {
+            t_last_predict_swarm = t_now;
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            if (_sf.node_frames.size() >= 1) {
+                std::unique_lock<std::mutex> anchor_guard(anchor_lock);
+                if (offload_mode == "follower" && anchor_predictor.can_predict(self_id, leader_timeout)) {
+                    SwarmFrame sf = swarm_frame_from_msg(_sf);
+                    std::map<int, Eigen::Vector3d> vo_vels;
+                    for (auto & _nf : _sf.node_frames) {
+                        vo_vels[_nf.id] = Eigen::Vector3d(_nf.velocity.x, _nf.velocity.y, _nf.velocity.z);
+                    }
+                    SwarmFrameState _sfs = anchor_predictor.predict(sf, self_id, vo_vels);
+                    anchor_guard.unlock();
+                    if (pub_swarm_odom) {
+                        for (auto & it: _sfs.node_poses) {
+                            this->pub_posevel_id(it.first, it.second, _sfs.node_covs[it.first], _sfs.node_vels[it.first], sf.stamp);
+                        }
+                    }
+                    if (_sfs.node_poses.find(self_id) != _sfs.node_poses.end()) {
+                        pub_fused_relative(_sfs, sf.stamp);
+                    }
+                } else if (swarm_localization_solver->CanPredictSwarm()) {
+                    anchor_guard.unlock();
+                    SwarmFrame sf = swarm_frame_from_msg(_sf);
+                    SwarmFrameState _sfs = swarm_localization_solver->PredictSwarm(sf);
+                    if (pub_swarm_odom) {
+                        for (auto & it: _sfs.node_poses) {
+                            this->pub_posevel_id(it.first, it.second, _sfs.node_covs[it.first], _sfs.node_vels[it.first], sf.stamp);
+                        }
+                    }
+                    pub_fused_relative(_sfs, sf.stamp);
+                } else {
+                    anchor_guard.unlock();
+                    pub_zero_base_coor(ros::Time::now());
+                    ROS_WARN_THROTTLE(1.0, "Unable to predict swarm");
+                    //ROS_WARN("Unable to predict swarm");
+                }
+                
+                high_resolution_clock::time_point t2 = high_resolution_clock::now();
+                auto duration = duration_cast<microseconds>( t2 - t1 ).count();
+                // double dts = (ros::Time::now() - ts).toSec();
+                //ROS_INFO_THROTTLE(1.0, "Predict cost %ld mus", duration);
+            }
+        }
+    }
+
+public:
+    SwarmLocalizationNode(ros::NodeHandle &_nh) :
+            nh(_nh) {
+        std::string swarm_node_config;
+
+        swarm_localization_solver_params solver_params;
+
+        nh.param<int>("max_keyframe_num", solver_params.max_frame_number, 50);
+        nh.param<int>("dense_keyframe_num", solver_params.dense_frame_number, 20);
+        nh.param<float>("global_solve_interval", solver_params.global_solve_interval, 0.0f);
+        nh.param<float>("global_solver_time", solver_params.global_solver_time, 1.0f);
+        nh.param<float>("pcm_threshold", solver_params.pcm_threshold, 3.0f);
+        nh.param<float>("max_ingest_lag", solver_params.max_ingest_lag, 1.0f);
+        nh.param<float>("max_kf_movement_scale", solver_params.max_kf_movement_scale, 4.0f);
+        nh.param<bool>("cooperative_init", cooperative_init, false);
+        solver_params.cooperative_init = cooperative_init;
+        nh.param<bool>("factor_stats", solver_params.enable_factor_stats, false);
+        nh.param<int>("min_keyframe_num", solver_params.min_frame_number, 3);
+        nh.param<float>("force_freq", force_freq, 1.0f);
+        nh.param<float>("predict_freq", predict_freq, 10.0f);
+        nh.param<float>("max_accept_cost", solver_params.acpt_cost, 10.0f);
+        nh.param<float>("min_kf_movement", solver_params.kf_movement, 0.4f);
+        nh.param<float>("init_xy_movement", solver_params.init_xy_movement, 2.0f);
+        nh.param<float>("init_z_movement", solver_params.init_z_movement, 1.0f);
+        nh.param<float>("loop_outlier_threshold_pos", solver_params.loop_outlier_threshold_pos, 1.0f);
+        nh.param<float>("loop_outlier_threshold_yaw", solver_params.loop_outlier_threshold_yaw, 0.5f);
+        nh.param<float>("loop_outlier_threshold_distance", solver_params.loop_outlier_threshold_distance, 2.0f);
+        nh.param<float>("loop_outlier_threshold_distance_init", solver_params.loop_outlier_threshold_distance_init, 0.5f);
+        nh.param<float>("triangulate_thres", solver_params.DA_TRI_accept_thres, 0.01f);
+        nh.param<int>("thread_num", solver_params.thread_num, 1);
+        nh.param<bool>("pub_swarm_odom", pub_swarm_odom, false);
+        nh.param<bool>("enable_cgraph_generation", solver_params.enable_cgraph_generation, false);
+        nh.param<bool>("enable_detection", solver_params.enable_detection, true);
+        nh.param<bool>("enable_loop", solver_params.enable_loop, true);
+        nh.param<bool>("enable_distance", solver_params.enable_distance, true);
+        nh.param<bool>("enable_detection_depth", solver_params.enable_detection_depth, true);
+        nh.param<bool>("publish_full_path", publish_full_path, false);
+        nh.param<bool>("publish_full_path", solver_params.generate_full_path, false);
+        nh.param<bool>("path_publish_delta", path_publish_delta, false);
+        nh.param<float>("path_decimate_dt", path_decimate_dt, 0.0f);
+        nh.param<float>("path_decimate_distance", path_decimate_distance, 0.0f);
+        nh.param<float>("det_dpos_thres", solver_params.det_dpos_thres, 0.2f);
+        nh.param<bool>("kf_use_all_nodes", solver_params.kf_use_all_nodes, false);
+        nh.param<bool>("is_pc_replay", is_pc_replay, false);
+        nh.param<std::string>("cgraph_path", solver_params.cgraph_path, "/home/dji/cgraph.dot");
+        nh.param<std::string>("cgraph_formats", solver_params.cgraph_formats, "dot");
+        nh.param<std::string>("checkpoint_path", checkpoint_path, "");
+        nh.param<float>("checkpoint_interval", checkpoint_interval, 5.0f);
+        nh.param<float>("checkpoint_max_age", checkpoint_max_age, 30.0f);
+        nh.param<float>("detection_outlier_thres", solver_params.detection_outlier_thres, 0.5f);
+        nh.param<float>("detection_inv_dep_outlier_thres", solver_params.detection_inv_dep_outlier_thres, 0.5f);
+        nh.param<float>("max_solver_time", solver_params.max_solver_time, 0.05f);
+        nh.param<float>("distance_outlier_threshold", solver_params.distance_outlier_threshold, 0.3f);
+        nh.param<float>("distance_height_outlier_threshold", solver_params.distance_height_outlier_threshold, 0.5f);
+        nh.param<bool>("decentralized", solver_params.decentralized, false);
+        nh.param<float>("consensus_pos_std", solver_params.consensus_pos_std, 0.1f);
+        nh.param<float>("consensus_yaw_std", solver_params.consensus_yaw_std, 0.05f);
+
+
+        nh.param<float>("VO_METER_STD_TRANSLATION", VO_METER_STD_TRANSLATION, 0.01f);
+        nh.param<float>("VO_METER_STD_Z", VO_METER_STD_Z, 0.02f);
+        nh.param<float>("VO_METER_STD_ANGLE", VO_METER_STD_ANGLE, 0.01f);
+        nh.param<float>("DISTANCE_STD", DISTANCE_STD, 0.2f);
+
+        nh.param<float>("LOOP_POS_STD_0", LOOP_POS_STD_0, 0.5f);
+        nh.param<float>("LOOP_YAW_STD_0", LOOP_YAW_STD_0, 0.5f);
+        nh.param<float>("LOOP_POS_STD_SLOPE", LOOP_POS_STD_SLOPE, 0.5f);
+        nh.param<float>("LOOP_YAW_STD_SLOPE", LOOP_YAW_STD_SLOPE, 0.5f);
+
+        nh.param<float>("DETECTION_SPHERE_STD", DETECTION_SPHERE_STD, 0.1f);
+        nh.param<float>("DETECTION_INV_DEP_STD", DETECTION_INV_DEP_STD, 0.5f);
+        nh.param<float>("DETECTION_DEP_STD", DETECTION_DEP_STD, 0.5f);
+        nh.param<double>("cg/x", CG.x(), 0);
+        nh.param<double>("cg/y", CG.y(), 0);
+        nh.param<double>("cg/z", CG.z(), 0);
+
+
+        nh.param<std::string>("swarm_nodes_config", swarm_node_config, "/home/xuhao/swarm_ws/src/swarm_pkgs/swarm_localization/config/swarm_nodes5.yaml");
+
+        nh.param<std::string>("offload_mode", offload_mode, "none");
+        nh.param<float>("leader_timeout", leader_timeout, 3.0f);
+        nh.param<bool>("failover", failover, true);
+        std::vector<int> _leader_ids;
+        nh.param<std::vector<int>>("leader_ids", _leader_ids, std::vector<int>());
+        leader_ids = std::set<int>(_leader_ids.begin(), _leader_ids.end());
+        if (offload_mode == "leader") {
+            ROS_INFO("Compute offload leader: base coordinates are broadcasted by localization_proxy as anchors");
+        } else if (offload_mode == "follower") {
+            if (leader_ids.empty()) {
+                ROS_ERROR("Compute offload follower needs leader_ids, solve by self instead");
+                offload_mode = "none";
+            } else {
+                ROS_INFO("Compute offload follower: predict by anchors of %ld leaders, failover %d", leader_ids.size(), failover);
+            }
+        }
+
+        load_nodes_from_file(swarm_node_config);
+        swarm_localization_solver = new SwarmLocalizationSolver(solver_params);
+        if (!checkpoint_path.empty()) {
+            restore_checkpoint();
+        }
+        fused_drone_data_pub = nh.advertise<swarm_msgs::swarm_fused>("/swarm_drones/swarm_drone_fused", 10);
+        fused_drone_basecoor_pub = nh.advertise<swarm_msgs::swarm_drone_basecoor>("/swarm_drones/swarm_drone_basecoor", 10);
+        fused_drone_rel_data_pub = nh.advertise<swarm_msgs::swarm_fused_relative>(
+                "/swarm_drones/swarm_drone_fused_relative", 10);
+        solving_cost_pub = nh.advertise<std_msgs::Float32>("/swarm_drones/solving_cost", 10);
+        factor_stats_pub = nh.advertise<swarm_localization::SwarmFactorStats>("/swarm_drones/factor_stats", 10);
+        path_snapshot_srv = nh.advertiseService("path_snapshot", &SwarmLocalizationNode::on_path_snapshot_request, this);
+
+        //Subscribe at last, callbacks run on other threads of spinner once subscribed
+        recv_sf_est = nh.subscribe("/swarm_drones/swarm_frame", 1000,
+                                          &SwarmLocalizationNode::on_swarmframe_recv, this,
+                                          ros::TransportHints().tcpNoDelay());
+        
+        recv_sf_predict = nh.subscribe("/swarm_drones/swarm_frame_predict", 1,
+                                          &SwarmLocalizationNode::predict_swarm, this,
+                                          ros::TransportHints().tcpNoDelay());
+        
+        loop_connection_sub = nh.subscribe("/swarm_loop/loop_connection", 10, 
+                                    &SwarmLocalizationNode::on_loop_connection_received, this, 
+                                    ros::TransportHints().tcpNoDelay());
+        
+        swarm_detected_sub = nh.subscribe("/swarm_drones/node_detected", 10, &SwarmLocalizationNode::on_swarm_detected, this, ros::TransportHints().tcpNoDelay());
+
+        if (cooperative_init || solver_params.decentralized || offload_mode == "follower") {
+            //Base coordinates of neighbors are sent over UWB by localization_proxy and decoded to this topic
+            remote_basecoor_sub = nh.subscribe("/swarm_drones/remote_basecoor", 10,
+                &SwarmLocalizationNode::on_remote_basecoor_recv, this, ros::TransportHints().tcpNoDelay());
+        }
+
+        if (solver_params.decentralized) {
+            ROS_INFO("Decentralized mode: only optimize self poses, neighbors are held by their base coordinates");
+        }
+
+
+        ROS_INFO("Max Keyframe %d. Generate CGraph %d path %s\n", solver_params.max_frame_number, solver_params.enable_cgraph_generation, solver_params.cgraph_path.c_str());
+    }
+};
@@ -11,6 +11,8 @@
 #include <swarm_msgs/swarm_types.hpp>
 #include <mutex>
 #include <swarm_msgs/LoopConnection.h>
+#include "swarm_localization/loop_pcm.hpp"
+#include "swarm_localization/factor_stats.hpp"
 
 
 
@@ -26,6 +28,7 @@ struct SwarmHorizonError;
 struct SwarmLoopError;
 
 class LocalizationDAInit;
+class PoseGraphExporter;
 
 inline float rand_FloatRange(float a, float b) {
     return ((b - a) * ((float) rand() / RAND_MAX)) + a;
@@ -50,6 +53,10 @@ typedef std::map<int64_t, std::map<int, Eigen::Matrix4d>> EstimateCOV;
 typedef std::map<int, std::map<int64_t,double*>> EstimatePosesIDTS;
 typedef std::vector<std::pair<int64_t, int>> TSIDArray;
 typedef std::map<int, std::map<int64_t, int>>  IDTSIndex;
+//Coordinate offsets of drones broadcasted by a neighbor, id -> pose of vo frame of this drone in frame of the neighbor
+typedef std::map<int, Swarm::Pose> BaseCoors;
+//Swarm frame error of each swarm frame cost function in problem, for splitting residuals by drone pair
+typedef std::map<const CostFunction*, const SwarmFrameError*> SFErrorMap;
 
 
 struct swarm_localization_solver_params{
@@ -63,6 +70,7 @@ struct swarm_localization_solver_params{
     float init_z_movement = 1.0;
     int self_id = -1;
     std::string cgraph_path;
+    std::string cgraph_formats = "dot";
     float DA_TRI_accept_thres = 0.1;
     bool enable_cgraph_generation = false;
     float loop_outlier_threshold_pos = 1.0;
@@ -81,6 +89,23 @@ struct swarm_localization_solver_params{
     float max_solver_time;
     float distance_outlier_threshold;
     float distance_height_outlier_threshold;
+    bool decentralized = false;
+    float consensus_pos_std = 0.1;
+    float consensus_yaw_std = 0.05;
+    //Window states out of last dense_frame_number keyframes are only refined by global solve every global_solve_interval seconds
+    float global_solve_interval = 0;
+    float global_solver_time = 1.0;
+    //Threshold of pairwise consistency of loops in std, non positive to disable
+    float pcm_threshold = 3.0;
+    //Keyframe movement threshold and solve interval are scaled up to max_kf_movement_scale when solve can't keep up
+    float max_ingest_lag = 1.0;
+    float max_kf_movement_scale = 4.0;
+    //Initialize from coordinate offsets broadcasted by neighbors before random multiple init
+    bool cooperative_init = false;
+    //Evaluate residual statistics of each factor after solve
+    bool enable_factor_stats = false;
+    //Exit the process on critical failure of ceres, otherwise throw std::runtime_error
+    bool exit_on_failure = true;
 };
 
 class SwarmLocalizationSolver {
@@ -139,6 +164,8 @@ class SwarmLocalizationSolver {
 
     void sync_est_poses(const EstimatePoses &_est_poses_tsid, bool is_init_solve);
 
+    void update_full_path(int _id, const Swarm::Path & _kf_path, bool full_regenerate);
+
 
     std::vector<Swarm::GeneralMeasurement2Drones*> find_available_loops_detections(std::map<int, std::set<int>> & loop_edges);
 
@@ -151,11 +178,11 @@ class SwarmLocalizationSolver {
     bool check_outlier_detection(const NodeFrame & _nf_a, const NodeFrame & _nf_b, const DroneDetection & det_ret) const;
 
     CostFunction *
-    _setup_cost_function_by_sf(const SwarmFrame &sf, std::map<int, int> id2poseindex, bool is_lastest_frame, int & res_num) const;
+    _setup_cost_function_by_sf(const SwarmFrame &sf, std::map<int, int> id2poseindex, bool is_lastest_frame, int & res_num, const SwarmFrameError* & sferror) const;
 
 
     int
-    setup_problem_with_sferror(const EstimatePoses &swarm_est_poses, Problem &problem, const SwarmFrame &sf, TSIDArray & param_indexs, bool is_lastest_frame) const;
+    setup_problem_with_sferror(const EstimatePoses &swarm_est_poses, Problem &problem, const SwarmFrame &sf, TSIDArray & param_indexs, bool is_lastest_frame, SFErrorMap & sf_errors) const;
 
     CostFunction *
     _setup_cost_function_by_nf_win(std::vector<NodeFrame> &nf_win, const std::map<int64_t, int> & ts2poseindex, bool is_self) const;
@@ -166,11 +193,19 @@ class SwarmLocalizationSolver {
     _setup_cost_function_by_loop(const Swarm::GeneralMeasurement2Drones* loops) const;
 
     void setup_problem_with_loops(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const;
-    
+
+    void setup_problem_with_consensus(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const;
+
+    void apply_boundary_states(EstimatePoses &swarm_est_poses);
+
+    bool is_boundary_pair(int _id_a, int _id_b) const;
+
+    void setup_problem_parameterization(const EstimatePoses & swarm_est_poses, Problem &problem) const;
+
     
     void cutting_edges();
 
-    double solve_once(EstimatePoses &swarm_est_poses, EstimatePosesIDTS &est_poses_idts, bool report = false);
+    double solve_once(EstimatePoses &swarm_est_poses, EstimatePosesIDTS &est_poses_idts, bool report = false, bool dense_only = false);
     
     int judge_is_key_frame(const SwarmFrame &sf);
 
@@ -193,8 +228,63 @@ class SwarmLocalizationSolver {
 
     void generate_cgraph();
 
+    PoseGraphExporter * exporter = nullptr;
+
     bool generate_full_path = false;
 
+    //Keyframe poses used for last full path generation, id -> ts -> pose
+    std::map<int, std::map<int64_t, Swarm::Pose>> full_path_kf_refs;
+
+    //Decentralized mode: each drone only optimize its own poses, other drones are held at the poses
+    //their base coordinates give, aligned to frame of self
+    bool decentralized = false;
+    float consensus_pos_std;
+    float consensus_yaw_std;
+    std::set<int> boundary_ids;
+
+    //Two tier window: dense solve on recent keyframes at each solve, global solve on full window at low rate
+    float global_solve_interval = 0;
+    float global_solver_time = 1.0;
+    int64_t last_global_solve_ts = 0;
+
+    bool need_global_solve() const;
+
+    int fix_sparse_states(const EstimatePoses & swarm_est_poses, Problem &problem) const;
+
+    LoopPCM loop_pcm;
+
+    //Load adaptive keyframe admission
+    float max_ingest_lag = 1.0;
+    float max_kf_movement_scale = 4.0;
+    double kf_movement_scale = 1.0;
+    double solve_latency_avg = 0;
+    bool has_new_loop = false;
+
+    //Base coordinates of neighbors for cooperative warm start and decentralized mode, neighbor id -> (stamp, base coordinates)
+    bool cooperative_init = false;
+    std::map<int, std::pair<ros::Time, BaseCoors>> neighbor_basecoors;
+    //Local time when base coordinates of each neighbor are received
+    std::map<int, ros::Time> neighbor_basecoor_recv;
+
+    bool warm_start_from_neighbor();
+
+    //Drones appeared after init, back after leaving sliding window (e.g. comms loss) or with observability changed;
+    //they are admitted by solving only their own states with the existing solution fixed
+    std::set<int> admitting_ids;
+    int admit_fail_count = 0;
+
+    bool in_sliding_window(int _id) const;
+
+    std::set<int> observability_changed_ids(const std::map<int, bool> & last_pos_observability, const std::map<int, bool> & last_yaw_observability) const;
+
+    bool admit_new_drones();
+
+    bool solve_new_drones(int max_number);
+
+    bool enable_factor_stats = false;
+
+    void evaluate_factor_stats(const EstimatePosesIDTS & est_poses_idts, const Problem &problem, const SFErrorMap & sf_errors);
+
 public:
     int self_id = -1;
     unsigned int thread_num;
@@ -236,6 +326,7 @@ public:
     std::string cgraph_path = "";
 
     SwarmLocalizationSolver(const swarm_localization_solver_params & params);
+    ~SwarmLocalizationSolver();
     
     void add_new_swarm_frame(const SwarmFrame &sf);
 
@@ -243,6 +334,32 @@ public:
 
     void add_new_detection(const swarm_msgs::node_detected_xyzyaw & detected);
 
+    bool is_decentralized() const {
+        return decentralized;
+    }
+
+    void add_neighbor_basecoor(int _id, ros::Time stamp, const BaseCoors & coors);
+
+    //Update keyframe admission with wall time of last solve and lag of ingested frames, in seconds
+    void update_load(double solve_latency, double ingest_lag, double solve_period);
+
+    double load_scale() const {
+        return kf_movement_scale;
+    }
+
+    //For checkpoint and warm restart
+    std::vector<int64_t> keyframe_ts() const;
+
+    std::map<int64_t, std::map<int, Swarm::Pose>> keyframe_poses() const;
+
+    //Only accepted loops and detections which fall in sliding window are kept in checkpoint
+    std::vector<swarm_msgs::LoopConnection> window_loop_connections() const;
+
+    std::vector<swarm_msgs::node_detected_xyzyaw> window_detections() const;
+
+    void restore(const std::vector<SwarmFrame> & keyframes, const std::map<int64_t, std::map<int, Swarm::Pose>> & poses,
+        const std::vector<swarm_msgs::LoopConnection> & loops, const std::vector<swarm_msgs::node_detected_xyzyaw> & dets);
+
     SwarmFrameState PredictSwarm(const SwarmFrame &sf) const;
 
     bool PredictNode(const NodeFrame & nf, Pose & _pose, Eigen::Matrix4d & cov) const;
@@ -254,6 +371,9 @@ public:
 
     double solve_time_count = 0;
 
+    //Residual statistics of last solve after init
+    FactorStatsMap factor_stats;
+
 
     double solve();
 
@@ -0,0 +1,80 @@
+#pragma once
+#include <map>
+#include "ros/ros.h"
+#include <swarm_msgs/swarm_frame.h>
+#include <swarm_msgs/node_frame.h>
+#include <swarm_msgs/swarm_types.hpp>
+#include "swarm_localization/swarm_localization_params.hpp"
+
+using namespace Swarm;
+
+//Conversion of swarm frame messages to solver types, shared by the node and the scenario generator
+
+inline NodeFrame node_frame_from_msg(const std::map<int, Swarm::Node *> & all_node_defs, const swarm_msgs::node_frame &_nf) {
+    //TODO: Deal with global pose
+    if (all_node_defs.find(_nf.id) == all_node_defs.end()) {
+        ROS_ERROR("No such node %d", _nf.id);
+        exit(-1);
+    }
+    NodeFrame nf(all_node_defs.at(_nf.id), VO_DRIFT_XYZ, VO_METER_STD_ANGLE);
+    nf.stamp = _nf.header.stamp;
+    nf.ts = nf.stamp.toNSec();
+    nf.frame_available = true;
+    nf.vo_available = _nf.vo_available;
+    nf.dists_available = !_nf.dismap_ids.empty();
+    nf.id = _nf.id;
+
+    assert(_nf.dismap_ids.size() == _nf.dismap_dists.size() && "Dismap ids and distance must equal size");
+
+    for (unsigned int i = 0; i < _nf.dismap_ids.size(); i++) {
+        if (all_node_defs.find(_nf.dismap_ids[i]) != all_node_defs.end()) {
+            // nf.dis_map[_nf.dismap_ids[i]] = _nf.dismap_dists[i] + nf.bias(_nf.dismap_ids[i]);
+            nf.dis_map[_nf.dismap_ids[i]] = nf.to_real_distance(_nf.dismap_dists[i], _nf.dismap_ids[i]);
+        }
+
+    }
+
+    if (nf.vo_available) {
+        nf.self_pose = Pose(_nf.position, _nf.yaw);
+        // ROS_WARN("Node %d vo valid", _nf.id);
+        nf.is_valid = true;
+
+    } else {
+        if (nf.node->has_odometry()) {
+            // ROS_WARN_THROTTLE(1.0, "Node %d invalid: No vo now", _nf.id);
+            // ROS_WARN("Node %d invalid: No vo now", _nf.id);
+        }
+        nf.is_valid = false;
+    }
+
+    for (auto nd_xyzyaw: _nf.detected_xyzyaws) {
+        DroneDetection dobj(nd_xyzyaw, false, CG);
+        nf.detected_nodes.push_back(dobj);
+    }
+
+    return nf;
+}
+
+inline SwarmFrame swarm_frame_from_msg(const std::map<int, Swarm::Node *> & all_node_defs, const swarm_msgs::swarm_frame &_sf) {
+    SwarmFrame sf;
+
+    sf.stamp = _sf.header.stamp;
+    sf.ts = sf.stamp.toNSec();
+    sf.self_id = _sf.self_id;
+
+    for (const swarm_msgs::node_frame &_nf: _sf.node_frames) {
+        if (all_node_defs.find(_nf.id) != all_node_defs.end()) {
+            NodeFrame nf = node_frame_from_msg(all_node_defs, _nf);
+            //Set nf ts to sf ts here; Trick for early version
+            nf.ts = sf.ts;
+
+            if (nf.is_static || (!nf.is_static && nf.vo_available)) { //If not static then must has vo
+                sf.id2nodeframe[_nf.id] = nf;
+                sf.node_id_list.insert(_nf.id);
+                sf.dis_mat[_nf.id] = sf.id2nodeframe[_nf.id].dis_map;
+            }
+        }
+    }
+
+    return sf;
+}
@@ -0,0 +1,294 @@
+#pragma once
+#include <random>
+#include <vector>
+#include <map>
+#include "ros/ros.h"
+#include "yaml-cpp/yaml.h"
+#include <eigen3/Eigen/Dense>
+#include <swarm_msgs/swarm_frame.h>
+#include <swarm_msgs/node_frame.h>
+#include <swarm_msgs/LoopConnection.h>
+#include <swarm_msgs/node_detected_xyzyaw.h>
+#include <swarm_msgs/swarm_types.hpp>
+
+using namespace Swarm;
+
+//Synthetic swarm for benchmark of solver without real flights
+//All drones fly figure-eight tracks of different size through the origin, so they meet each other and revisit places
+struct swarm_scenario_params {
+    int drone_num = 5;
+    double frame_rate = 10.0;
+    double duration = 120.0;
+    double speed = 1.0;
+    double area_radius = 10.0;
+    double height = 1.5;
+    //VO drift in std per meter flight
+    double vo_drift_xyz = 0.02;
+    double vo_drift_yaw = 0.002;
+    double range_std = 0.1;
+    double range_dropout = 0.1;
+    double range_max = 50.0;
+    //Detection is generated in body frame of the observer with unit direction and inverse depth
+    double detection_range = 5.0;
+    double detection_prob = 0.05;
+    double detection_std = 0.02;
+    //Loop closures per drone per second
+    double loop_freq = 0.1;
+    double loop_max_distance = 1.0;
+    double loop_min_dt = 10.0;
+    double loop_pos_std = 0.05;
+    double loop_yaw_std = 0.01;
+    int seed = 0;
+};
+
+class SwarmScenarioGenerator {
+    swarm_scenario_params params;
+    std::mt19937 rng;
+    std::normal_distribution<double> normal_dist = std::normal_distribution<double>(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform_dist = std::uniform_real_distribution<double>(0.0, 1.0);
+
+    double t = 0;
+    ros::Time t0;
+    std::vector<int> ids;
+    std::map<int, double> track_phase;
+    std::map<int, double> track_radius;
+    std::map<int, Pose> vo_poses;
+    std::map<int, Pose> gt_poses;
+    std::map<int, std::vector<int64_t>> frame_ts;
+
+    double randn() {
+        return normal_dist(rng);
+    }
+
+    double randu() {
+        return uniform_dist(rng);
+    }
+
+    Pose gt_pose_at(int _id, double _t) const {
+        double R = track_radius.at(_id);
+        double theta = params.speed / R * _t + track_phase.at(_id);
+        Eigen::Vector3d pos(R * cos(theta), R * sin(2*theta) / 2, params.height + 0.5 * sin(0.3 * _t + track_phase.at(_id)));
+        Eigen::Vector3d vel(-sin(theta), cos(2*theta), 0);
+        return Pose(pos, atan2(vel.y(), vel.x()));
+    }
+
+    Pose noisy_delta(const Pose & dpose) {
+        double dis = dpose.pos().norm();
+        Eigen::Vector3d noise(randn(), randn(), randn());
+        return Pose(dpose.pos() + noise * params.vo_drift_xyz * dis, dpose.yaw() + randn() * params.vo_drift_yaw * dis);
+    }
+
+    swarm_msgs::node_detected_xyzyaw generate_detection(int _id, int _idj, ros::Time stamp) {
+        swarm_msgs::node_detected_xyzyaw nd;
+        Pose dpose = Pose::DeltaPose(gt_poses[_id], gt_poses[_idj], true);
+        Eigen::Vector3d dpos = dpose.pos();
+        double dis = dpos.norm();
+        dpos.normalize();
+        dpos = dpos + Eigen::Vector3d(randn(), randn(), randn()) * params.detection_std;
+        dpos.normalize();
+
+        nd.header.stamp = stamp;
+        nd.self_drone_id = _id;
+        nd.remote_drone_id = _idj;
+        nd.dpos.x = dpos.x();
+        nd.dpos.y = dpos.y();
+        nd.dpos.z = dpos.z();
+        nd.inv_dep = 1 / dis;
+        nd.enable_scale = true;
+        nd.local_pose_self = vo_poses[_id].to_ros_pose();
+        nd.dpos_std.x = params.detection_std;
+        nd.dpos_std.y = params.detection_std;
+        nd.dpos_std.z = params.detection_std;
+        nd.probaility = 1.0;
+        nd.is_yaw_valid = false;
+        return nd;
+    }
+
+    bool generate_loop(int _idb, int64_t ts_b, swarm_msgs::LoopConnection & loop) {
+        int _ida = ids[rand_index(ids.size())];
+        auto & tss = frame_ts[_ida];
+        int64_t min_dt = (int64_t)(params.loop_min_dt * 1e9);
+        if (tss.empty() || ts_b - tss[0] < min_dt) {
+            return false;
+        }
+
+        int64_t ts_a = tss[rand_index(tss.size())];
+        if (ts_b - ts_a < min_dt) {
+            return false;
+        }
+
+        Pose gt_a = ground_truth[_ida][ts_a];
+        Pose gt_b = ground_truth[_idb][ts_b];
+        if ((gt_a.pos() - gt_b.pos()).norm() > params.loop_max_distance) {
+            return false;
+        }
+
+        Pose dpose = Pose::DeltaPose(gt_a, gt_b, true);
+        loop.id_a = _ida;
+        loop.ts_a.fromNSec(ts_a);
+        loop.id_b = _idb;
+        loop.ts_b.fromNSec(ts_b);
+        loop.self_pose_a = vo_pathes[_ida][ts_a].to_ros_pose();
+        loop.self_pose_b = vo_pathes[_idb][ts_b].to_ros_pose();
+        loop.dpos.x = dpose.pos().x() + randn() * params.loop_pos_std;
+        loop.dpos.y = dpose.pos().y() + randn() * params.loop_pos_std;
+        loop.dpos.z = dpose.pos().z() + randn() * params.loop_pos_std;
+        loop.dyaw = dpose.yaw() + randn() * params.loop_yaw_std;
+        loop.keyframe_id_a = -1;
+        loop.keyframe_id_b = -1;
+        loop.pnp_inlier_num = 100;
+        return true;
+    }
+
+    int rand_index(int size) {
+        return std::min((int)(randu() * size), size - 1);
+    }
+
+public:
+    //id -> ts -> pose
+    std::map<int, std::map<int64_t, Pose>> ground_truth;
+    std::map<int, std::map<int64_t, Pose>> vo_pathes;
+
+    SwarmScenarioGenerator(const swarm_scenario_params & _params, ros::Time _t0) :
+        params(_params), rng(_params.seed), t0(_t0) {
+        for (int i = 0; i < params.drone_num; i++) {
+            int _id = i + 1;
+            ids.push_back(_id);
+            track_phase[_id] = 2 * M_PI * i / params.drone_num;
+            track_radius[_id] = params.area_radius * (0.5 + 0.5 * (i + 1) / params.drone_num);
+
+            //Each vo starts in its own frame, which is unknown to solver
+            Pose base(Eigen::Vector3d(randn(), randn(), 0) * params.area_radius, (randu() * 2 - 1) * M_PI);
+            gt_poses[_id] = gt_pose_at(_id, 0);
+            vo_poses[_id] = Pose::DeltaPose(base, gt_poses[_id], true);
+        }
+    }
+
+    const std::vector<int> & drone_ids() const {
+        return ids;
+    }
+
+    YAML::Node nodes_config() const {
+        YAML::Node nodes;
+        for (int _id : ids) {
+            YAML::Node node;
+            node["has_uwb"] = true;
+            node["has_armarkers"] = false;
+            node["has_camera"] = true;
+            node["has_vo"] = true;
+            node["is_static"] = false;
+            node["has_global_pose"] = false;
+            node["anntena_pos"] = std::vector<double>{0, 0, 0};
+            for (int _idj : ids) {
+                node["bias"][_idj] = std::vector<double>{0.0, 1.0};
+            }
+            nodes[_id] = node;
+        }
+        return nodes;
+    }
+
+    std::map<int, Node*> create_node_defs() const {
+        std::map<int, Node*> node_defs;
+        YAML::Node nodes = nodes_config();
+        for (int _id : ids) {
+            node_defs[_id] = new Node(_id, nodes[_id]);
+        }
+        return node_defs;
+    }
+
+    //Generate swarm frame viewed from first drone and loops detected at this frame; return false when scenario ends
+    bool step(swarm_msgs::swarm_frame & sf, std::vector<swarm_msgs::LoopConnection> & loops) {
+        if (t > params.duration) {
+            return false;
+        }
+
+        t += 1.0 / params.frame_rate;
+        ros::Time stamp = t0 + ros::Duration(t);
+        int64_t ts = stamp.toNSec();
+
+        for (int _id : ids) {
+            Pose gt_now = gt_pose_at(_id, t);
+            vo_poses[_id] = vo_poses[_id] * noisy_delta(Pose::DeltaPose(gt_poses[_id], gt_now, true));
+            gt_poses[_id] = gt_now;
+            ground_truth[_id][ts] = gt_now;
+            vo_pathes[_id][ts] = vo_poses[_id];
+        }
+
+        sf = swarm_msgs::swarm_frame();
+        sf.header.stamp = stamp;
+        sf.self_id = ids[0];
+
+        for (int _id : ids) {
+            swarm_msgs::node_frame nf;
+            nf.header.stamp = stamp;
+            nf.id = _id;
+            nf.vo_available = true;
+            nf.position = vo_poses[_id].to_ros_pose().position;
+            nf.yaw = vo_poses[_id].yaw();
+
+            for (int _idj : ids) {
+                if (_idj == _id) {
+                    continue;
+                }
+                double dis = (gt_poses[_id].pos() - gt_poses[_idj].pos()).norm();
+                if (dis < params.range_max && randu() > params.range_dropout) {
+                    nf.dismap_ids.push_back(_idj);
+                    nf.dismap_dists.push_back(dis + randn() * params.range_std);
+                }
+
+                if (dis < params.detection_range && randu() < params.detection_prob) {
+                    nf.detected_xyzyaws.push_back(generate_detection(_id, _idj, stamp));
+                }
+            }
+
+            sf.node_frames.push_back(nf);
+        }
+
+        loops.clear();
+        for (int _id : ids) {
+            swarm_msgs::LoopConnection loop;
+            if (randu() < params.loop_freq / params.frame_rate && generate_loop(_id, ts, loop)) {
+                loops.push_back(loop);
+            }
+            frame_ts[_id].push_back(ts);
+        }
+
+        return true;
+    }
+
+    //RMSE of estimated poses of other drones relative to the self drone, which is independent of the frame of estimation
+    int evaluate(const std::map<int, Swarm::Path> & est_pathes, int self_id, double & pos_rmse, double & yaw_rmse) const {
+        pos_rmse = 0;
+        yaw_rmse = 0;
+        int count = 0;
+        if (est_pathes.find(self_id) == est_pathes.end()) {
+            return 0;
+        }
+
+        std::map<int64_t, Pose> self_est(est_pathes.at(self_id).begin(), est_pathes.at(self_id).end());
+        for (auto & it : est_pathes) {
+            int _id = it.first;
+            if (_id == self_id || ground_truth.find(_id) == ground_truth.end()) {
+                continue;
+            }
+            for (auto & pose_stamped : it.second) {
+                int64_t ts = pose_stamped.first;
+                if (self_est.find(ts) == self_est.end() || ground_truth.at(_id).find(ts) == ground_truth.at(_id).end()) {
+                    continue;
+                }
+                Pose est_rel = Pose::DeltaPose(self_est.at(ts), pose_stamped.second, true);
+                Pose gt_rel = Pose::DeltaPose(ground_truth.at(self_id).at(ts), ground_truth.at(_id).at(ts), true);
+                pos_rmse += (est_rel.pos() - gt_rel.pos()).squaredNorm();
+                double dyaw = wrap_angle(est_rel.yaw() - gt_rel.yaw());
+                yaw_rmse += dyaw * dyaw;
+                count ++;
+            }
+        }
+
+        if (count > 0) {
+            pos_rmse = sqrt(pos_rmse / count);
+            yaw_rmse = sqrt(yaw_rmse / count);
+        }
+        return count;
+    }
+};
@@ -0,0 +1,254 @@
+#include "swarm_localization/pose_graph_exporter.hpp"
+#include "swarm_localization/swarm_localization_params.hpp"
+#include <ros/ros.h>
+#include <graphviz/cgraph.h>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+
+using namespace std::chrono;
+
+//Roll and pitch are not estimated, use a large information for them in g2o
+#define G2O_FIXED_ROT_INFO 1e6
+
+PoseGraphExporter::PoseGraphExporter(const std::string & _dot_path, const std::string & formats) :
+    dot_path(_dot_path) {
+    base_path = dot_path;
+    if (base_path.size() > 4 && base_path.compare(base_path.size() - 4, 4, ".dot") == 0) {
+        base_path = base_path.substr(0, base_path.size() - 4);
+    }
+
+    export_dot = formats.find("dot") != std::string::npos;
+    export_binary = formats.find("bin") != std::string::npos;
+    export_g2o = formats.find("g2o") != std::string::npos;
+
+    th = std::thread(&PoseGraphExporter::worker, this);
+}
+
+PoseGraphExporter::~PoseGraphExporter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+    cv.notify_all();
+    th.join();
+}
+
+void PoseGraphExporter::submit(PoseGraphSnapshot && snapshot) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = std::move(snapshot);
+        has_pending = true;
+    }
+    cv.notify_one();
+}
+
+void PoseGraphExporter::worker() {
+    while (true) {
+        PoseGraphSnapshot snapshot;
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+            cv.wait(ulock, [&] { return has_pending || !running; });
+            if (!has_pending) {
+                return;
+            }
+            snapshot = std::move(pending);
+            has_pending = false;
+        }
+
+        auto start = high_resolution_clock::now();
+        if (export_dot) {
+            write_dot(snapshot, dot_path);
+        }
+        if (export_binary) {
+            write_binary(snapshot, base_path + ".bin");
+        }
+        if (export_g2o) {
+            write_g2o(snapshot, base_path + ".g2o");
+        }
+        double dt = duration_cast<microseconds>(high_resolution_clock::now() - start).count()/1000.0;
+        ROS_INFO("Export pose graph to %s cost %4.3fms", base_path.c_str(), dt);
+    }
+}
+
+void PoseGraphExporter::write_dot(const PoseGraphSnapshot & snapshot, const std::string & path) const {
+    Agraph_t *g;
+    g = agopen("G", Agdirected, NULL);
+    char node_name[100] = {0};
+    char edgename[100] = {0};
+
+    agattr(g,AGRAPH,"shape","box");
+    agattr(g,AGRAPH,"style","filled");
+    agattr(g,AGRAPH,"label","Pose Graphs");
+    agattr(g,AGNODE,"style","filled");
+    agattr(g,AGEDGE,"color","black");
+    agattr(g,AGEDGE,"label","residual");
+
+    std::map<int64_t, std::map<int, Agnode_t*>> AGNodes;
+    std::map<int64_t, Agraph_t*> sub_graphs;
+
+    for (auto ts : snapshot.frames) {
+        sprintf(node_name, "cluster_%d", TSShort(ts));
+        auto sub_graph = agsubg(g, node_name, 1);
+        auto t = ros::Time();
+        t.fromNSec(ts);
+        sprintf(node_name, "SwarmFrame %f", t.toSec());
+        agattrsym (sub_graph, "label");
+        agset (sub_graph, "label", node_name);
+        sub_graphs[ts] = sub_graph;
+        AGNodes[ts] = std::map<int, Agnode_t*>();
+    }
+
+    for (auto & v : snapshot.vertices) {
+        sprintf(node_name, "Node%d_%d", v.id, TSShort(v.ts));
+        AGNodes[v.ts][v.id] = agnode(sub_graphs[v.ts], node_name, 1);
+    }
+
+    int count = 0;
+    for (auto & e : snapshot.edges) {
+        auto node1 = AGNodes[e.ts_a][e.id_a];
+        auto node2 = AGNodes[e.ts_b][e.id_b];
+        if (node1 == nullptr || node2 == nullptr) {
+            continue;
+        }
+        char loopname[32] = {0};
+        Agedge_t * edge = nullptr;
+        switch (e.type) {
+            case PoseGraphSnapshot::VIO:
+                edge = agedge(g, node1, node2, "VIO", 1);
+                snprintf(edgename, sizeof(edgename), "VIO:RP:[%3.2f,%3.2f,%3.2f],%4.3fdeg", e.rel_pose.pos().x(), e.rel_pose.pos().y(), e.rel_pose.pos().z(),
+                    e.rel_pose.yaw()*57.3);
+                break;
+            case PoseGraphSnapshot::Distance:
+                edge = agedge(g, node1, node2, "Dis", 1);
+                snprintf(edgename, sizeof(edgename), "Dis %3.2f", e.distance);
+                break;
+            case PoseGraphSnapshot::FrameDetection:
+                edge = agedge(g, node1, node2, "Det", 1);
+                snprintf(edgename, sizeof(edgename), "Detected");
+                break;
+            case PoseGraphSnapshot::Loop:
+                snprintf(loopname, sizeof(loopname), "Loop %d", count);
+                edge = agedge(g, node1, node2, loopname, 1);
+                snprintf(edgename, sizeof(edgename), "loop(%d->%d dt %4.1fms); DP [%3.2f,%3.2f,%3.2f] DY %4.3f",
+                    e.id_a, e.id_b, (e.ts_b - e.ts_a)/1000000.0,
+                    e.rel_pose.pos().x(),
+                    e.rel_pose.pos().y(),
+                    e.rel_pose.pos().z(),
+                    e.rel_pose.yaw()*57.3
+                );
+                count += 1;
+                break;
+            case PoseGraphSnapshot::Detection:
+                snprintf(loopname, sizeof(loopname), "Det %d", count);
+                edge = agedge(g, node1, node2, loopname, 1);
+                snprintf(edgename, sizeof(edgename), "Detection(%d->%d)", e.id_a, e.id_b);
+                count += 1;
+                break;
+        }
+
+        agattrsym (edge, "label");
+        agset(edge, "label", edgename);
+        if (e.type == PoseGraphSnapshot::Loop || e.type == PoseGraphSnapshot::Detection) {
+            agattrsym (edge, "color");
+            agset(edge, "color", "orange");
+        }
+    }
+
+    FILE * f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        ROS_WARN("Unable to open %s for cgraph", path.c_str());
+        agclose(g);
+        return;
+    }
+    agwrite(g,f);
+    agclose(g);
+    fclose(f);
+}
+
+//Binary layout, little endian:
+//"SPG1" uint32 frame_num uint32 vertex_num uint32 edge_num
+//frames: int64 ts
+//vertices: int64 ts, int32 id, double x y z yaw
+//edges: int32 type, int64 ts_a, int32 id_a, int64 ts_b, int32 id_b, double dx dy dz dyaw distance
+void PoseGraphExporter::write_binary(const PoseGraphSnapshot & snapshot, const std::string & path) const {
+    FILE * f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        ROS_WARN("Unable to open %s for binary pose graph", path.c_str());
+        return;
+    }
+
+    fwrite("SPG1", 1, 4, f);
+    uint32_t nums[3] = {(uint32_t)snapshot.frames.size(), (uint32_t)snapshot.vertices.size(), (uint32_t)snapshot.edges.size()};
+    fwrite(nums, sizeof(uint32_t), 3, f);
+    fwrite(snapshot.frames.data(), sizeof(int64_t), snapshot.frames.size(), f);
+
+    for (auto & v : snapshot.vertices) {
+        int32_t id = v.id;
+        double pose[4] = {v.pose.pos().x(), v.pose.pos().y(), v.pose.pos().z(), v.pose.yaw()};
+        fwrite(&v.ts, sizeof(int64_t), 1, f);
+        fwrite(&id, sizeof(int32_t), 1, f);
+        fwrite(pose, sizeof(double), 4, f);
+    }
+
+    for (auto & e : snapshot.edges) {
+        int32_t type = e.type, id_a = e.id_a, id_b = e.id_b;
+        double data[5] = {e.rel_pose.pos().x(), e.rel_pose.pos().y(), e.rel_pose.pos().z(), e.rel_pose.yaw(), e.distance};
+        fwrite(&type, sizeof(int32_t), 1, f);
+        fwrite(&e.ts_a, sizeof(int64_t), 1, f);
+        fwrite(&id_a, sizeof(int32_t), 1, f);
+        fwrite(&e.ts_b, sizeof(int64_t), 1, f);
+        fwrite(&id_b, sizeof(int32_t), 1, f);
+        fwrite(data, sizeof(double), 5, f);
+    }
+    fclose(f);
+}
+
+//g2o text with VERTEX_SE3:QUAT and EDGE_SE3:QUAT, distance and frame detection edges has no g2o type and are kept as comments
+void PoseGraphExporter::write_g2o(const PoseGraphSnapshot & snapshot, const std::string & path) const {
+    FILE * f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        ROS_WARN("Unable to open %s for g2o pose graph", path.c_str());
+        return;
+    }
+
+    std::map<int64_t, std::map<int, int>> vertex_index;
+    int index = 0;
+    for (auto & v : snapshot.vertices) {
+        vertex_index[v.ts][v.id] = index;
+        fprintf(f, "VERTEX_SE3:QUAT %d %f %f %f 0 0 %f %f\n", index,
+            v.pose.pos().x(), v.pose.pos().y(), v.pose.pos().z(), sin(v.pose.yaw()/2), cos(v.pose.yaw()/2));
+        index ++;
+    }
+
+    for (auto & e : snapshot.edges) {
+        if (vertex_index[e.ts_a].find(e.id_a) == vertex_index[e.ts_a].end() ||
+            vertex_index[e.ts_b].find(e.id_b) == vertex_index[e.ts_b].end()) {
+            continue;
+        }
+        int a = vertex_index[e.ts_a][e.id_a];
+        int b = vertex_index[e.ts_b][e.id_b];
+        if (e.type == PoseGraphSnapshot::Distance) {
+            fprintf(f, "# EDGE_RANGE %d %d %f %f\n", a, b, e.distance, 1/(DISTANCE_STD*DISTANCE_STD));
+            continue;
+        }
+        if (e.type == PoseGraphSnapshot::FrameDetection || e.type == PoseGraphSnapshot::Detection) {
+            fprintf(f, "# EDGE_DETECTION %d %d\n", a, b);
+            continue;
+        }
+
+        double pos_std = VO_METER_STD_TRANSLATION, yaw_std = VO_METER_STD_ANGLE;
+        if (e.type == PoseGraphSnapshot::Loop) {
+            pos_std = LOOP_POS_STD_0;
+            yaw_std = LOOP_YAW_STD_0;
+        }
+        double pos_info = 1/(pos_std*pos_std), yaw_info = 1/(yaw_std*yaw_std);
+        auto & dp = e.rel_pose;
+        fprintf(f, "EDGE_SE3:QUAT %d %d %f %f %f 0 0 %f %f ", a, b,
+            dp.pos().x(), dp.pos().y(), dp.pos().z(), sin(dp.yaw()/2), cos(dp.yaw()/2));
+        //Upper triangle of 6x6 information matrix
+        fprintf(f, "%f 0 0 0 0 0 %f 0 0 0 0 %f 0 0 0 %f 0 0 %f 0 %f\n",
+            pos_info, pos_info, pos_info, G2O_FIXED_ROT_INFO, G2O_FIXED_ROT_INFO, yaw_info);
+    }
+    fclose(f);
+}
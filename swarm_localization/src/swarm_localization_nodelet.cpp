@@ -0,0 +1,21 @@
+#include "swarm_localization/swarm_localization_node.hpp"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace swarm_localization_pkg
+{
+    class SwarmLocalizationNodelet : public nodelet::Nodelet
+    {
+        public:
+            SwarmLocalizationNodelet() {}
+        private:
+            SwarmLocalizationNode * node = nullptr;
+            virtual void onInit() override
+            {
+                srand(time(NULL));
+                ros::NodeHandle & n = getMTPrivateNodeHandle();
+                node = new SwarmLocalizationNode(n);
+            }
+    };
+    PLUGINLIB_EXPORT_CLASS(swarm_localization_pkg::SwarmLocalizationNodelet, nodelet::Nodelet);
+}
@@ -20,7 +20,9 @@
 #include <swarm_msgs/swarm_types.hpp>
 #include <set>
 #include <chrono>
-#include <graphviz/cgraph.h>
+#include <limits>
+#include <stdexcept>
+#include "swarm_localization/pose_graph_exporter.hpp"
 #include "swarm_localization/localization_DA_init.hpp"
 
 using namespace std::chrono;
@@ -53,6 +55,17 @@ using namespace std::chrono;
 
 #define INIT_TRIAL 3
 
+//Load adaptive keyframe admission
+#define LOAD_LATENCY_FILTER 0.8
+#define LOAD_SCALE_UP 1.25
+#define LOAD_SCALE_DOWN 1.1
+
+//Max age of base coordinates from neighbor for warm start, in seconds
+#define WARM_START_MAX_AGE 5.0
+
+//Failed admission of new drones before falling back to init of whole swarm
+#define MAX_ADMIT_FAIL 5
+
 #define BEGIN_MIN_LOOP_DT 100.0
 
 //For testing loop closure for single drone, use 1
@@ -63,6 +76,13 @@ using namespace std::chrono;
 
 #define DISTANCE_CROSS_THRESS 0.15
 
+#define FULL_PATH_SAMPLE_STEP 10
+#define FULL_PATH_KF_CHANGE_POS 1e-4
+#define FULL_PATH_KF_CHANGE_YAW 1e-4
+
+//Base coordinates of neighbor received earlier than this (in seconds) are not used as boundary
+#define NEIGHBOR_STATE_MAX_DT 5.0
+
 
 float VO_METER_STD_TRANSLATION;
 float VO_METER_STD_Z;
@@ -99,10 +119,28 @@ SwarmLocalizationSolver::SwarmLocalizationSolver(const swarm_localization_solver
             distance_outlier_threshold(_params.distance_outlier_threshold),
             distance_height_outlier_threshold(_params.distance_height_outlier_threshold),
             loop_outlier_threshold_distance(_params.loop_outlier_threshold_distance),
-            loop_outlier_threshold_distance_init(_params.loop_outlier_threshold_distance_init)
+            loop_outlier_threshold_distance_init(_params.loop_outlier_threshold_distance_init),
+            decentralized(_params.decentralized),
+            consensus_pos_std(_params.consensus_pos_std),
+            consensus_yaw_std(_params.consensus_yaw_std),
+            global_solve_interval(_params.global_solve_interval),
+            global_solver_time(_params.global_solver_time),
+            loop_pcm(_params.pcm_threshold),
+            max_ingest_lag(_params.max_ingest_lag),
+            max_kf_movement_scale(_params.max_kf_movement_scale),
+            cooperative_init(_params.cooperative_init),
+            enable_factor_stats(_params.enable_factor_stats)
     {
+        if (enable_cgraph_generation) {
+            exporter = new PoseGraphExporter(cgraph_path, _params.cgraph_formats);
+        }
     }
 
+SwarmLocalizationSolver::~SwarmLocalizationSolver() {
+    //Exporter finishes the snapshot being written and joins its thread
+    delete exporter;
+}
+
 
 Swarm::Pose Predict_By_VO(Swarm::Pose vo_now, Swarm::Pose vo_ref, Swarm::Pose est_pose_ref, bool is_yaw_only) {
     return est_pose_ref * Pose::DeltaPose(vo_ref, vo_now, is_yaw_only);
@@ -134,6 +172,17 @@ int SwarmLocalizationSolver::judge_is_key_frame(const SwarmFrame &sf) {
         return 0;
     }
 
+    if (has_new_loop && sf.id2nodeframe.at(self_id).vo_available && last_sf.has_odometry(self_id) &&
+        (sf.position(self_id) - last_sf.position(self_id)).norm() > min_accept_keyframe_movement) {
+        //Keep a keyframe near the new loop, so it can be matched in window; only load scaling of movement is skipped
+        node_kf_count[self_id] += 1;
+        ROS_INFO("SF %d is kf for new loop", TSShort(sf.ts));
+        return 1;
+    }
+
+    //Movement threshold grows with load; frames with detection keep the unscaled threshold
+    double kf_movement = min_accept_keyframe_movement * kf_movement_scale;
+
     if (kf_use_all_nodes) {
         for (auto _id : _ids) {
             const NodeFrame & self_nf = sf.id2nodeframe.at(_id);
@@ -141,7 +190,7 @@ int SwarmLocalizationSolver::judge_is_key_frame(const SwarmFrame &sf) {
                 Eigen::Vector3d _diff = sf.position(_id) - last_sf.position(_id);
 
                 //TODO: make it set to if last dont's have some detection and this frame has, than keyframe
-                if (_diff.norm() > min_accept_keyframe_movement || 
+                if (_diff.norm() > kf_movement || 
                     _diff.norm() > min_accept_keyframe_movement/3 && self_nf.has_detection() ) { //here shall be some one see him or he see someone
                     ret.push_back(_id);
                     node_kf_count[_id] += 1;
@@ -155,7 +204,7 @@ int SwarmLocalizationSolver::judge_is_key_frame(const SwarmFrame &sf) {
         if (self_nf.vo_available && last_sf.has_node(self_id) && last_sf.has_odometry(self_id)) {
             Eigen::Vector3d _diff = sf.position(self_id) - last_sf.position(self_id);
             double dt = (sf.ts - last_sf.ts)/1e9;
-            if (_diff.norm() > min_accept_keyframe_movement || (_diff.norm() > min_accept_keyframe_movement/2 && dt > 0.2) ||
+            if (_diff.norm() > kf_movement || (_diff.norm() > kf_movement/2 && dt > 0.2) ||
                 _diff.norm() > min_accept_keyframe_movement/3 && self_nf.has_detection()  //here shall be some one see him or he see someone
             ) {
                 ret.push_back(self_id);
@@ -484,6 +533,7 @@ void SwarmLocalizationSolver::add_as_keyframe(SwarmFrame sf) {
         // last_kf_ts = sf_sld_win.back().ts;
     // }
     ROS_INFO("New keyframe %d found, size %ld/%d", TSShort(sf.ts), sf_sld_win.size(), max_frame_number);
+    has_new_loop = false;
     for (auto & it : sf.id2nodeframe) {
         if (it.second.is_static) {
             ROS_INFO("Is static");
@@ -520,9 +570,14 @@ void SwarmLocalizationSolver::add_new_loop_connection(const swarm_msgs::LoopConn
         return;
     }
     if (enable_loop) {
+        if (!loop_pcm.add_loop(loop_con)) {
+            ROS_WARN("Loop %d(%d)->%d(%d) is not consistent with other loops of this pair",
+                loc_ret.id_a, TSShort(loc_ret.ts_a), loc_ret.id_b, TSShort(loc_ret.ts_b));
+        }
 #ifndef DEBUG_LOOP_ONLY_INIT
         all_loops.push_back(loop_con);
         has_new_keyframe = true;
+        has_new_loop = true;
 #else
         if (!finish_init) {
             all_loops.push_back(loop_con);
@@ -532,6 +587,91 @@ void SwarmLocalizationSolver::add_new_loop_connection(const swarm_msgs::LoopConn
     }
 }
 
+std::vector<int64_t> SwarmLocalizationSolver::keyframe_ts() const {
+    std::vector<int64_t> ret;
+    for (const SwarmFrame & sf : sf_sld_win) {
+        ret.push_back(sf.ts);
+    }
+    return ret;
+}
+
+std::vector<swarm_msgs::LoopConnection> SwarmLocalizationSolver::window_loop_connections() const {
+    std::vector<swarm_msgs::LoopConnection> ret;
+    for (auto & _loc : all_loops) {
+        Swarm::LoopConnection loc_ret;
+        double dt_err = 0;
+        double dpos;
+        if (loop_pcm.is_inlier(_loc) && loop_from_src_loop_connection(_loc, loc_ret, dt_err, dpos) == 1) {
+            ret.push_back(_loc);
+        }
+    }
+    return ret;
+}
+
+std::vector<swarm_msgs::node_detected_xyzyaw> SwarmLocalizationSolver::window_detections() const {
+    std::vector<swarm_msgs::node_detected_xyzyaw> ret;
+    for (auto & _det : all_detections) {
+        Swarm::DroneDetection det_ret;
+        double dt_err = 0;
+        double dpos;
+        if (detection_from_src_node_detection(_det, det_ret, dt_err, dpos)) {
+            ret.push_back(_det);
+        }
+    }
+    return ret;
+}
+
+std::map<int64_t, std::map<int, Swarm::Pose>> SwarmLocalizationSolver::keyframe_poses() const {
+    std::map<int64_t, std::map<int, Swarm::Pose>> ret;
+    for (const SwarmFrame & sf : sf_sld_win) {
+        if (est_poses_tsid.find(sf.ts) == est_poses_tsid.end()) {
+            continue;
+        }
+        for (auto it : est_poses_tsid.at(sf.ts)) {
+            ret[sf.ts][it.first] = Pose(it.second, true);
+        }
+    }
+    return ret;
+}
+
+void SwarmLocalizationSolver::restore(const std::vector<SwarmFrame> & keyframes, const std::map<int64_t, std::map<int, Swarm::Pose>> & poses,
+        const std::vector<swarm_msgs::LoopConnection> & loops, const std::vector<swarm_msgs::node_detected_xyzyaw> & dets) {
+    for (const SwarmFrame & sf : keyframes) {
+        for (int _id : sf.node_id_list) {
+            all_nodes.insert(_id);
+            node_kf_count[_id] += 1;
+        }
+        if (sf.node_id_list.size() > drone_num) {
+            drone_num = sf.node_id_list.size();
+        }
+        add_as_keyframe(sf);
+    }
+
+    //Overwrite the initial value of keyframes with checkpoint, shared static poses are overwritten by same value
+    for (auto & it : poses) {
+        if (est_poses_tsid.find(it.first) == est_poses_tsid.end()) {
+            continue;
+        }
+        auto & _est_poses = est_poses_tsid.at(it.first);
+        for (auto & it2 : it.second) {
+            if (_est_poses.find(it2.first) != _est_poses.end()) {
+                Pose _pose = it2.second;
+                _pose.to_vector_xyzyaw(_est_poses.at(it2.first));
+            }
+        }
+    }
+
+    all_loops = loops;
+    for (auto & loop : loops) {
+        loop_pcm.add_loop(loop);
+    }
+    all_detections = dets;
+    last_drone_num = drone_num;
+    //Next solve runs as a normal solve from the restored estimate; a bad cost falls back to initialization
+    finish_init = !keyframes.empty();
+    has_new_keyframe = true;
+    ROS_INFO("Restored %ld keyframes, %ld loops and %ld detections from checkpoint", keyframes.size(), loops.size(), dets.size());
+}
 
 void SwarmLocalizationSolver::replace_last_kf(const SwarmFrame &sf) {
     delete_frame_i(sf_sld_win.size()-1);
@@ -572,14 +712,31 @@ void SwarmLocalizationSolver::add_new_swarm_frame(const SwarmFrame &sf) {
     }
 
     if (is_kf == 1) {
-        int num = all_nodes.size();
+        std::set<int> new_ids;
+        std::set<int> back_ids;
         for (int _id : _ids) {
+            if (all_nodes.find(_id) == all_nodes.end()) {
+                new_ids.insert(_id);
+            } else if (_id != self_id && !in_sliding_window(_id)) {
+                //Known drone with no keyframe left in window, e.g. after comms loss; its old solution is gone with the window
+                back_ids.insert(_id);
+            }
             all_nodes.insert(_id);
         }
 
-        if (all_nodes.size() > num) {
-            finish_init = false;
-            enable_to_init = false;
+        if (!new_ids.empty()) {
+            if (finish_init) {
+                //Existing solution is kept, new drones are localized against it
+                admitting_ids.insert(new_ids.begin(), new_ids.end());
+                ROS_INFO("%ld new drones appear, admit them to current solution", new_ids.size());
+            } else {
+                enable_to_init = false;
+            }
+        }
+
+        if (!back_ids.empty() && finish_init) {
+            admitting_ids.insert(back_ids.begin(), back_ids.end());
+            ROS_INFO("%ld drones are back to sliding window, admit them to current solution", back_ids.size());
         }
 
         add_as_keyframe(sf);
@@ -769,6 +926,163 @@ bool SwarmLocalizationSolver::solve_with_multiple_init(int max_number) {
 }
 
 
+void SwarmLocalizationSolver::add_neighbor_basecoor(int _id, ros::Time stamp, const BaseCoors & coors) {
+    if ((cooperative_init || decentralized) && _id != self_id) {
+        neighbor_basecoors[_id] = std::make_pair(stamp, coors);
+        neighbor_basecoor_recv[_id] = ros::Time::now();
+    }
+}
+
+bool SwarmLocalizationSolver::warm_start_from_neighbor() {
+    //Use the freshest neighbor which knows all drones in window
+    int64_t last_ts = sf_sld_win.back().ts;
+    const BaseCoors * coors = nullptr;
+    int neighbor = -1;
+    ros::Time stamp;
+    for (auto & it : neighbor_basecoors) {
+        if (fabs((sf_sld_win.back().stamp - it.second.first).toSec()) > WARM_START_MAX_AGE ||
+            (coors != nullptr && it.second.first < stamp)) {
+            continue;
+        }
+        bool has_all = true;
+        for (int _id : all_nodes) {
+            if (it.second.second.find(_id) == it.second.second.end()) {
+                has_all = false;
+                break;
+            }
+        }
+        if (has_all) {
+            coors = &it.second.second;
+            neighbor = it.first;
+            stamp = it.second.first;
+        }
+    }
+
+    if (coors == nullptr || est_poses_idts.find(self_id) == est_poses_idts.end()) {
+        return false;
+    }
+
+    //Offset of self vo frame in current estimate frame, so estimate frame of self is kept
+    auto self_last = est_poses_idts.at(self_id).rbegin();
+    Pose self_est(self_last->second, true);
+    Pose self_vo = all_sf.at(self_last->first).id2nodeframe.at(self_id).pose();
+    self_est.set_yaw_only();
+    self_vo.set_yaw_only();
+    Pose self_offset = Pose(self_est.to_isometry() * self_vo.to_isometry().inverse());
+    Pose neighbor_to_self = self_offset * coors->at(self_id).inverse();
+
+    for (int _id : all_nodes) {
+        if (_id == self_id || est_poses_idts.find(_id) == est_poses_idts.end()) {
+            continue;
+        }
+        Pose offset = neighbor_to_self * coors->at(_id);
+        for (auto it : est_poses_idts.at(_id)) {
+            Pose vo = all_sf.at(it.first).id2nodeframe.at(_id).pose();
+            vo.set_yaw_only();
+            Pose est = offset * vo;
+            est.to_vector_xyzyaw(it.second);
+        }
+    }
+
+    double cost = solve_once(est_poses_tsid, est_poses_idts, true);
+    if (cost < acpt_cost) {
+        cost_now = cost;
+        ROS_INFO("Warm start from base coordinates of drone %d at %d, cost %f", neighbor, TSShort(last_ts), cost);
+        return true;
+    }
+
+    ROS_WARN("Warm start from drone %d not consistent, cost %f; use multiple init", neighbor, cost);
+    return false;
+}
+
+bool SwarmLocalizationSolver::in_sliding_window(int _id) const {
+    for (const SwarmFrame & _sf : sf_sld_win) {
+        if (_sf.has_node(_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::set<int> SwarmLocalizationSolver::observability_changed_ids(const std::map<int, bool> & last_pos_observability, 
+        const std::map<int, bool> & last_yaw_observability) const {
+    std::set<int> ret;
+    for (auto it : last_yaw_observability) {
+        int _id = it.first;
+        //Self is the gauge and new drones are admitted anyway
+        if (_id == self_id || est_poses_idts.find(_id) == est_poses_idts.end() || 
+            yaw_observability.find(_id) == yaw_observability.end()) {
+            continue;
+        }
+        if (yaw_observability.at(_id) != it.second || 
+            (last_pos_observability.find(_id) != last_pos_observability.end() && pos_observability.at(_id) != last_pos_observability.at(_id))) {
+            ret.insert(_id);
+        }
+    }
+    return ret;
+}
+
+bool SwarmLocalizationSolver::admit_new_drones() {
+    if (solve_new_drones(INIT_TRIAL)) {
+        ROS_INFO("Admit %ld new drones", admitting_ids.size());
+        admitting_ids.clear();
+        admit_fail_count = 0;
+        return true;
+    }
+
+    admit_fail_count ++;
+    if (admit_fail_count >= MAX_ADMIT_FAIL) {
+        ROS_WARN("Could not admit new drones after %d trials, init whole swarm", admit_fail_count);
+        admitting_ids.clear();
+        admit_fail_count = 0;
+        finish_init = false;
+    }
+    return false;
+}
+
+bool SwarmLocalizationSolver::solve_new_drones(int max_number) {
+    double cost = acpt_cost;
+    bool cost_updated = false;
+    std::map<double*, Pose> _est_poses_best;
+
+    for (int i = 0; i < max_number; i++) {
+        //First trial starts from current states, e.g. a known drone whose observability changed
+        //Then random coordinate offset of each new drone, its states follow its vo
+        for (int _id : admitting_ids) {
+            if (i == 0 || est_poses_idts.find(_id) == est_poses_idts.end()) {
+                continue;
+            }
+            Eigen::Vector3d pos(rand_FloatRange(-RAND_INIT_XY, RAND_INIT_XY), rand_FloatRange(-RAND_INIT_XY, RAND_INIT_XY),
+                rand_FloatRange(-RAND_INIT_Z, RAND_INIT_Z));
+            Pose offset(pos, yaw_observability.at(_id) ? rand_FloatRange(-M_PI, M_PI) : 0);
+            for (auto it : est_poses_idts.at(_id)) {
+                Pose p = offset * all_sf.at(it.first).id2nodeframe.at(_id).pose();
+                p.to_vector_xyzyaw(it.second);
+            }
+        }
+
+        double c = solve_once(est_poses_tsid, est_poses_idts, true);
+        ROS_INFO("%d time of admission trial cost %f", i, c);
+        if (c < cost) {
+            cost_now = cost = c;
+            cost_updated = true;
+            for (int _id : admitting_ids) {
+                if (est_poses_idts.find(_id) == est_poses_idts.end()) {
+                    continue;
+                }
+                for (auto it : est_poses_idts.at(_id)) {
+                    _est_poses_best[it.second] = Pose(it.second, true);
+                }
+            }
+        }
+    }
+
+    for (auto & it : _est_poses_best) {
+        it.second.to_vector_xyzyaw(it.first);
+    }
+    return cost_updated;
+}
+
 std::pair<Eigen::Vector3d, Eigen::Vector3d> SwarmLocalizationSolver::boundingbox_sldwin(int _id) const {
     double xmax=-1000, xmin = 1000, ymax = -1000, ymin = 1000, zmax = -1000, zmin = 1000;
     for (const SwarmFrame & _sf : sf_sld_win ) {
@@ -808,12 +1122,22 @@ double SwarmLocalizationSolver::solve() {
     if (!has_new_keyframe)
         return -1;
     enable_to_init = false;
+    auto last_pos_observability = pos_observability;
+    auto last_yaw_observability = yaw_observability;
     estimate_observability();
     bool is_init_solve = false;
 
-    if (finish_init && !enable_to_init) {
-        ROS_WARN("Observability not meet now. set finish init to false!!!");
-        finish_init = false;
+    if (finish_init) {
+        //Drones whose observability changes are solved again against existing solution instead of init whole swarm,
+        //which only happens after MAX_ADMIT_FAIL failed admissions
+        auto changed_ids = observability_changed_ids(last_pos_observability, last_yaw_observability);
+        if (!changed_ids.empty()) {
+            ROS_WARN("Observability of %ld drones changes, admit them again to current solution", changed_ids.size());
+            admitting_ids.insert(changed_ids.begin(), changed_ids.end());
+        }
+        if (!enable_to_init) {
+            ROS_WARN("Observability not meet now, keep current solution");
+        }
     }
 
     // if (!finish_init) {
@@ -834,14 +1158,16 @@ double SwarmLocalizationSolver::solve() {
 
     if (!finish_init) {
         //Init procedure
+        admitting_ids.clear();
         if (enable_to_init) {
             is_init_solve = true;
             //generate_cgraph();
             ROS_INFO("No init before, try to init");
-            finish_init = solve_with_multiple_init(INIT_TRIAL);
+            finish_init = (cooperative_init && warm_start_from_neighbor()) || solve_with_multiple_init(INIT_TRIAL);
             if (finish_init) {
                 generate_cgraph();
                 last_drone_num = drone_num;
+                last_global_solve_ts = sf_sld_win.back().ts;
                 ROS_INFO("Finish init\n");
             }
         } else {
@@ -854,7 +1180,14 @@ double SwarmLocalizationSolver::solve() {
         if (enable_cgraph_generation) {
             generate_cgraph();
         }
-        cost_now = solve_once(this->est_poses_tsid, this->est_poses_idts, true);
+        if (!admitting_ids.empty() && !admit_new_drones()) {
+            return -1;
+        }
+        bool is_global_solve = need_global_solve();
+        cost_now = solve_once(this->est_poses_tsid, this->est_poses_idts, true, !is_global_solve);
+        if (is_global_solve) {
+            last_global_solve_ts = sf_sld_win.back().ts;
+        }
     }
 
     if (cost_now > acpt_cost) {
@@ -872,7 +1205,6 @@ void  SwarmLocalizationSolver::sync_est_poses(const EstimatePoses &_est_poses_ts
     ROS_INFO("Sync poses to saved while init successful");
     int64_t last_ts = sf_sld_win.back().ts;
     kf_pathes.clear();
-    full_pathes.clear();
 
     for (const SwarmFrame & sf : sf_sld_win) {
         //Only update param in sf to saved
@@ -921,35 +1253,89 @@ void  SwarmLocalizationSolver::sync_est_poses(const EstimatePoses &_est_poses_ts
 
     if (generate_full_path) {
         for (auto & it : kf_pathes) {
-            int id = it.first;
-            auto & _kf_path = it.second;
-            int index = 0;
-            full_pathes[id] = Swarm::Path(0);
-
-            int count = 0;
-            for (auto it : vo_pathes[id]) {
-
-                int64_t ts_vo = it.first;
-                int64_t ts_kf = _kf_path[index].first;
-                //Found closest KF Pose
-                if (count % 10 == 0 && _kf_path.size() > 0) {
-                    if (_kf_path.size() > 1) {
-                        while (llabs(ts_vo - _kf_path[index].first) > llabs(ts_vo - _kf_path[index + 1].first) && index+1<_kf_path.size()) {
-                            index ++;
-                        }
-                        ts_kf = _kf_path[index].first;
-                    }
+            update_full_path(it.first, it.second, is_init_solve);
+            // ROS_INFO("Full path of %d length %ld", it.first, full_pathes[it.first].size());
+        }
+    }
+}
 
-                    Pose pose_ref = _kf_path[index].second;
-                    Pose vo_ref = all_sf[ts_kf].id2nodeframe[id].pose();
-                    Pose est_ref = _kf_path[index].second;
-                    Pose pose = Predict_By_VO(it.second, vo_ref, est_ref);
-                    full_pathes[id].push_back(std::make_pair(ts_vo, pose));
-                }
-                count ++;
-            }
-            // ROS_INFO("Full path of %d length %ld", id, full_pathes[id].size());
+void SwarmLocalizationSolver::update_full_path(int _id, const Swarm::Path & _kf_path, bool full_regenerate) {
+    auto & full_path = full_pathes[_id];
+    auto & kf_refs = full_path_kf_refs[_id];
+    const auto & vo_path = vo_pathes[_id];
+
+    if (full_regenerate) {
+        //After a init solve the whole estimation may jump, nothing cached is valid
+        full_path.clear();
+        kf_refs.clear();
+    }
+
+    if (_kf_path.empty() || vo_path.empty()) {
+        return;
+    }
+
+    //Find the earliest keyframe which is new or moved since last generation
+    unsigned int changed_index = _kf_path.size();
+    for (unsigned int i = 0; i < _kf_path.size(); i++) {
+        auto it = kf_refs.find(_kf_path[i].first);
+        if (it == kf_refs.end()) {
+            changed_index = i;
+            break;
+        }
+        Pose dpose = Pose::DeltaPose(it->second, _kf_path[i].second, true);
+        if (dpose.pos().norm() > FULL_PATH_KF_CHANGE_POS || fabs(dpose.yaw()) > FULL_PATH_KF_CHANGE_YAW) {
+            changed_index = i;
+            break;
+        }
+    }
+
+    //VO poses are propagated from the closest keyframe, so only poses after the midpoint
+    //of the last unchanged keyframe and the changed one are affected.
+    //Poses before the sliding window keep the estimate of the keyframe they were generated from.
+    int64_t regen_ts = std::numeric_limits<int64_t>::max();
+    if (changed_index == 0) {
+        regen_ts = _kf_path[0].first;
+    } else if (changed_index < _kf_path.size()) {
+        regen_ts = (_kf_path[changed_index - 1].first + _kf_path[changed_index].first) / 2;
+    }
+
+    if (full_path.empty()) {
+        regen_ts = std::numeric_limits<int64_t>::min();
+    } else if (full_path.back().first < regen_ts) {
+        //New VO poses since last generation
+        regen_ts = full_path.back().first + 1;
+    }
+
+    auto ts_less = [](const std::pair<int64_t, Pose> & p, int64_t ts) {
+        return p.first < ts;
+    };
+
+    full_path.erase(std::lower_bound(full_path.begin(), full_path.end(), regen_ts, ts_less), full_path.end());
+
+    unsigned int vo_index = std::lower_bound(vo_path.begin(), vo_path.end(), regen_ts, ts_less) - vo_path.begin();
+    unsigned int kf_index = 0;
+    for (; vo_index < vo_path.size(); vo_index++) {
+        //Sample by index of VO path so the decimation is stable between generations
+        if (vo_index % FULL_PATH_SAMPLE_STEP != 0) {
+            continue;
+        }
+
+        int64_t ts_vo = vo_path[vo_index].first;
+        //Found closest KF Pose
+        while (kf_index + 1 < _kf_path.size() && 
+            llabs(ts_vo - _kf_path[kf_index].first) > llabs(ts_vo - _kf_path[kf_index + 1].first)) {
+            kf_index ++;
         }
+
+        int64_t ts_kf = _kf_path[kf_index].first;
+        Pose vo_ref = all_sf[ts_kf].id2nodeframe[_id].pose();
+        Pose pose = Predict_By_VO(vo_path[vo_index].second, vo_ref, _kf_path[kf_index].second);
+        full_path.push_back(std::make_pair(ts_vo, pose));
+    }
+
+    kf_refs.clear();
+    for (auto & it : _kf_path) {
+        kf_refs[it.first] = it.second;
     }
 }
 
@@ -958,7 +1344,7 @@ unsigned int SwarmLocalizationSolver::sliding_window_size() const {
 }
 
 CostFunction *
-SwarmLocalizationSolver::_setup_cost_function_by_sf(const SwarmFrame &sf, std::map<int, int> id2poseindex, bool is_lastest_frame, int & res_num) const {
+SwarmLocalizationSolver::_setup_cost_function_by_sf(const SwarmFrame &sf, std::map<int, int> id2poseindex, bool is_lastest_frame, int & res_num, const SwarmFrameError* & sferror_out) const {
     //Here we will only send
     std::map<int, double> yaw_init;
     for (const auto & it : sf.id2nodeframe) {
@@ -971,15 +1357,11 @@ SwarmLocalizationSolver::_setup_cost_function_by_sf(const SwarmFrame &sf, std::m
     }
     SwarmFrameError * sferror = new SwarmFrameError(sf, id2poseindex, yaw_observability, yaw_init);
     res_num = sferror->residual_count();
+    sferror_out = sferror;
     auto cost_function  = new SFErrorCost(sferror);
     
-    for (auto it : id2poseindex) {
-        int _id = it.first;
-        if (!yaw_observability.at(_id)) {
-            cost_function->AddParameterBlock(3);
-        } else {
-            cost_function->AddParameterBlock(4);
-        }
+    for (unsigned int i = 0; i < id2poseindex.size(); i++) {
+        cost_function->AddParameterBlock(4);
     }
 
     // assert(res_num > 0 &&"Set cost function with SF has 0 res num");
@@ -995,8 +1377,6 @@ SwarmLocalizationSolver::_setup_cost_function_by_sf(const SwarmFrame &sf, std::m
 CostFunction *
 SwarmLocalizationSolver::_setup_cost_function_by_loop(const Swarm::GeneralMeasurement2Drones* loc) const {
     int res_num = -1;
-    int ida = loc->id_a;
-    int idb = loc->id_b;
     if (loc->meaturement_type == Swarm::GeneralMeasurement2Drones::Loop) {
         auto sle = new SwarmLoopError(loc);
         auto cost_function = new LoopCost(sle);
@@ -1009,17 +1389,8 @@ SwarmLocalizationSolver::_setup_cost_function_by_loop(const Swarm::GeneralMeasur
         auto sle = new SwarmDetectionError(loc);
         auto cost_function = new DetectionCost(sle);
         res_num = sle->residual_count();
-        if (!yaw_observability.at(ida)) {
-            cost_function->AddParameterBlock(3);
-        } else {
-            cost_function->AddParameterBlock(4);
-        }
-
-        if (!yaw_observability.at(idb)) {
-            cost_function->AddParameterBlock(3);
-        } else {
-            cost_function->AddParameterBlock(4);
-        }
+        cost_function->AddParameterBlock(4);
+        cost_function->AddParameterBlock(4);
         cost_function->SetNumResiduals(res_num);
         return cost_function;
     }
@@ -1027,7 +1398,7 @@ SwarmLocalizationSolver::_setup_cost_function_by_loop(const Swarm::GeneralMeasur
     
 void SwarmLocalizationSolver::setup_problem_with_loops(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const {
     for (auto loc : good_2drone_measurements) {
-        if (!yaw_observability.at(loc->id_a) || !yaw_observability.at(loc->id_b)) {
+        if (!yaw_observability.at(loc->id_a) || !yaw_observability.at(loc->id_b) || is_boundary_pair(loc->id_a, loc->id_b)) {
             continue;
         }
         std::vector<double*> pose_state; // For involved poses
@@ -1050,6 +1421,159 @@ void SwarmLocalizationSolver::setup_problem_with_loops(const EstimatePosesIDTS &
     }
 }
     
+void SwarmLocalizationSolver::setup_problem_with_consensus(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const {
+    if (boundary_ids.empty() || est_poses_idts_saved.find(self_id) == est_poses_idts_saved.end()) {
+        return;
+    }
+
+    auto & saved = est_poses_idts_saved.at(self_id);
+    bool yaw_obser = yaw_observability.at(self_id);
+    for (auto it : est_poses_idts.at(self_id)) {
+        int64_t ts = it.first;
+        double * pose = it.second;
+        if (saved.find(ts) == saved.end() || !problem.HasParameterBlock(pose)) {
+            continue;
+        }
+        auto sce = new SwarmConsensusError(Pose(saved.at(ts), true), yaw_obser, pose[3],
+            Eigen::Vector3d::Ones() * consensus_pos_std, consensus_yaw_std);
+        auto cost_function = new ConsensusCost(sce);
+        cost_function->AddParameterBlock(4);
+        cost_function->SetNumResiduals(sce->residual_count());
+        problem.AddResidualBlock(cost_function, nullptr, pose);
+    }
+}
+
+void SwarmLocalizationSolver::setup_problem_parameterization(const EstimatePoses & swarm_est_poses, Problem &problem) const {
+    //All poses are 4 dof blocks; yaw of drones with unobservable yaw is held by subset parameterization instead of a 3 dof block
+    //Problem owns the parameterizations and deletes each of them once, so they are shared by all blocks
+    auto pose_param = new PoseXYZYawParameterization;
+    auto fixed_yaw_param = new ceres::SubsetParameterization(4, std::vector<int>{3});
+    std::set<double*> states;
+    bool pose_param_used = false, fixed_yaw_param_used = false;
+    for (auto & it : swarm_est_poses) {
+        for (auto it2 : it.second) {
+            double * state = it2.second;
+            if (!problem.HasParameterBlock(state) || states.find(state) != states.end()) {
+                continue;
+            }
+            states.insert(state);
+            if (yaw_observability.at(it2.first)) {
+                problem.SetParameterization(state, pose_param);
+                pose_param_used = true;
+            } else {
+                problem.SetParameterization(state, fixed_yaw_param);
+                fixed_yaw_param_used = true;
+            }
+        }
+    }
+
+    if (!pose_param_used) {
+        delete pose_param;
+    }
+    if (!fixed_yaw_param_used) {
+        delete fixed_yaw_param;
+    }
+}
+
+void SwarmLocalizationSolver::apply_boundary_states(EstimatePoses &swarm_est_poses) {
+    boundary_ids.clear();
+    Pose self_offset;
+    Eigen::Matrix4d self_cov;
+    if (!decentralized || !finish_init || sf_sld_win.empty() || !NodeCooridnateOffset(self_id, self_offset, self_cov)) {
+        return;
+    }
+
+    //Base coordinates of a neighbor are in its own estimate frame. Its estimate of self is aligned to ours,
+    //so the relative poses it estimated are kept
+    std::map<int, Pose> offsets;
+    ros::Time now = ros::Time::now();
+    for (auto & it : neighbor_basecoors) {
+        int _id = it.first;
+        auto & coors = it.second.second;
+        if ((now - neighbor_basecoor_recv.at(_id)).toSec() > NEIGHBOR_STATE_MAX_DT ||
+            est_poses_idts.find(_id) == est_poses_idts.end() ||
+            coors.find(_id) == coors.end() || coors.find(self_id) == coors.end()) {
+            continue;
+        }
+        Pose neighbor_to_self = self_offset * coors.at(self_id).inverse();
+        offsets[_id] = neighbor_to_self * coors.at(_id);
+        boundary_ids.insert(_id);
+    }
+
+    for (SwarmFrame & sf : sf_sld_win) {
+        for (auto & it : sf.id2nodeframe) {
+            int _id = it.first;
+            NodeFrame & _nf = it.second;
+            if (boundary_ids.find(_id) == boundary_ids.end() || _nf.is_static) {
+                continue;
+            }
+
+            Pose vo = _nf.pose();
+            vo.set_yaw_only();
+            Pose est = offsets.at(_id) * vo;
+            est.to_vector_xyzyaw(swarm_est_poses.at(sf.ts).at(_id));
+
+            //Distances between two boundary drones only give constant cost
+            for (auto & dis : _nf.dis_map) {
+                if (is_boundary_pair(_id, dis.first)) {
+                    _nf.enabled_distance[dis.first] = false;
+                }
+            }
+        }
+    }
+}
+
+bool SwarmLocalizationSolver::is_boundary_pair(int _id_a, int _id_b) const {
+    return boundary_ids.find(_id_a) != boundary_ids.end() && boundary_ids.find(_id_b) != boundary_ids.end();
+}
+
+void SwarmLocalizationSolver::update_load(double solve_latency, double ingest_lag, double solve_period) {
+    solve_latency_avg = LOAD_LATENCY_FILTER * solve_latency_avg + (1 - LOAD_LATENCY_FILTER) * solve_latency;
+    double scale = kf_movement_scale;
+    if (solve_latency_avg > solve_period || ingest_lag > max_ingest_lag) {
+        scale = std::min(scale * LOAD_SCALE_UP, (double) max_kf_movement_scale);
+    } else if (solve_latency_avg < solve_period / 2 && ingest_lag < max_ingest_lag / 2) {
+        scale = std::max(scale / LOAD_SCALE_DOWN, 1.0);
+    }
+
+    if (fabs(scale - kf_movement_scale) > 1e-3) {
+        ROS_INFO("Solve latency %4.1fms ingest lag %4.2fs, keyframe movement scale %3.2f->%3.2f",
+            solve_latency_avg*1000, ingest_lag, kf_movement_scale, scale);
+        kf_movement_scale = scale;
+    }
+}
+
+bool SwarmLocalizationSolver::need_global_solve() const {
+    if (global_solve_interval <= 0 || sf_sld_win.size() <= dense_frame_number) {
+        return true;
+    }
+    return (sf_sld_win.back().ts - last_global_solve_ts) / 1e9 > global_solve_interval;
+}
+
+int SwarmLocalizationSolver::fix_sparse_states(const EstimatePoses & swarm_est_poses, Problem &problem) const {
+    //Static nodes share one state over keyframes, they are free if seen by any dense keyframe
+    std::set<double*> dense_states;
+    unsigned int dense_begin = sf_sld_win.size() - dense_frame_number;
+    for (unsigned int i = dense_begin; i < sf_sld_win.size(); i++) {
+        for (auto it : swarm_est_poses.at(sf_sld_win[i].ts)) {
+            dense_states.insert(it.second);
+        }
+    }
+
+    int count = 0;
+    for (unsigned int i = 0; i < dense_begin; i++) {
+        for (auto it : swarm_est_poses.at(sf_sld_win[i].ts)) {
+            double * state = it.second;
+            if (dense_states.find(state) == dense_states.end() && problem.HasParameterBlock(state) &&
+                !problem.IsParameterBlockConstant(state)) {
+                problem.SetParameterBlockConstant(state);
+                count ++;
+            }
+        }
+    }
+    return count;
+}
+
 bool SwarmLocalizationSolver::check_outlier_detection(const NodeFrame & _nf_a, const NodeFrame & _nf_b, const DroneDetection & det_ret) const {
     auto reta = get_estimated_pose(_nf_a.id, _nf_a.ts);
     auto retb = get_estimated_pose(_nf_b.id, _nf_b.ts);
@@ -1083,27 +1607,27 @@ bool SwarmLocalizationSolver::check_outlier_detection(const NodeFrame & _nf_a, c
     return false;
 }
 
-int SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & swarm_est_poses, Problem& problem, const SwarmFrame& sf, TSIDArray& param_indexs, bool is_lastest_frame) const {
+int SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & swarm_est_poses, Problem& problem, const SwarmFrame& sf, TSIDArray& param_indexs, bool is_lastest_frame, SFErrorMap & sf_errors) const {
     //TODO: Deal with static object in this function!!!
     int _dets = detection_in_keyframes;
     std::vector<double*> pose_state;
     std::map<int, int> id2poseindex;
-    std::vector<int> _id_list;
     int64_t ts = sf.ts;
     for(auto it : sf.id2nodeframe) {
         int _id = it.first;
         // ROS_INFO("Add TS %d ID %d", TSShort(ts), _id);
         pose_state.push_back(swarm_est_poses.at(ts).at(_id));
-        _id_list.push_back(_id);
         id2poseindex[_id] = pose_state.size() - 1;
         param_indexs.push_back(std::pair<int64_t, int>(ts, _id));
     }
     int res_num = 0;
     auto loss_function = new ceres::HuberLoss(1.0);
-    CostFunction * cost = _setup_cost_function_by_sf(sf, id2poseindex, is_lastest_frame, res_num);
+    const SwarmFrameError * sferror = nullptr;
+    CostFunction * cost = _setup_cost_function_by_sf(sf, id2poseindex, is_lastest_frame, res_num, sferror);
 
     if (cost != nullptr) {
         problem.AddResidualBlock(cost, loss_function, pose_state);
+        sf_errors[cost] = sferror;
         if (finish_init) {
             /*
             printf("SF Evaluate ERROR ts %d", TSShort(ts));
@@ -1116,14 +1640,7 @@ int SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & sw
         }
     } else {
         for (unsigned int i = 0; i < pose_state.size(); i ++) {
-            double * _state = pose_state[i];
-            int _id = _id_list[i];
-            
-            if (!yaw_observability.at(_id)) {
-                problem.AddParameterBlock(_state, 3);
-            } else {
-                problem.AddParameterBlock(_state, 4);
-            }
+            problem.AddParameterBlock(pose_state[i], 4);
         }
     }
 
@@ -1137,7 +1654,7 @@ int SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & sw
                 int _idb = det.id_b;
                 det.enable_depth = enable_detection_depth;
                 if (swarm_est_poses.at(ts).find(_idb) != swarm_est_poses.at(ts).end() &&
-                    sf.id2nodeframe.find(_idb) != sf.id2nodeframe.end()) {
+                    sf.id2nodeframe.find(_idb) != sf.id2nodeframe.end() && !is_boundary_pair(_id, _idb)) {
                     double * poseb = swarm_est_poses.at(ts).at(_idb);
                     auto & nfb = sf.id2nodeframe.at(_idb);
                     if (check_outlier_detection(nfa, nfb, det)) {
@@ -1172,11 +1689,7 @@ SwarmLocalizationSolver::_setup_cost_function_by_nf_win(std::vector<NodeFrame> &
     int poses_num = nf_win.size();
 
     for (int i =0;i < poses_num; i ++) {
-        if (!yaw_observability.at(_id)) {
-            cost_function->AddParameterBlock(3);
-        } else {
-            cost_function->AddParameterBlock(4);
-        }
+        cost_function->AddParameterBlock(4);
     }
     if (res_num == 0) {
         ROS_WARN("Set cost function with NF has 0 res num; NF id %d WIN %ld", nf_win[0].id, nf_win.size());
@@ -1714,8 +2227,15 @@ std::vector<GeneralMeasurement2Drones*> SwarmLocalizationSolver::find_available_
     std::vector<Swarm::DroneDetection> good_detections;
     std::vector<GeneralMeasurement2Drones*> ret;
     std::vector<int> outlier_loops;
+    if (!sf_sld_win.empty()) {
+        //Loops which can't be found in window any more are left out of consistency check
+        loop_pcm.drop_before(sf_sld_win[0].stamp.toNSec() - (int64_t)(BEGIN_MIN_LOOP_DT*1e9));
+    }
     for (int i = 0; i < all_loops.size(); i++) {
         auto _loc = all_loops[i];
+        if (!loop_pcm.is_inlier(_loc)) {
+            continue;
+        }
         Swarm::LoopConnection loc_ret;
         double dt_err = 0;
         double dpos;
@@ -1783,7 +2303,107 @@ std::vector<GeneralMeasurement2Drones*> SwarmLocalizationSolver::find_available_
     return ret;
 }
 
-double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, bool report) {
+//Evaluate each residual block at the solution once; residuals are whitened so their RMS is the error in std
+void SwarmLocalizationSolver::evaluate_factor_stats(const EstimatePosesIDTS & est_poses_idts, const Problem &problem, const SFErrorMap & sf_errors) {
+    std::map<const double*, int> state_ids;
+    for (auto & it : est_poses_idts) {
+        for (auto it2 : it.second) {
+            state_ids[it2.second] = it.first;
+        }
+    }
+
+    factor_stats.clear();
+    std::vector<ResidualBlockId> res_blocks;
+    problem.GetResidualBlocks(&res_blocks);
+    std::vector<double*> states;
+    std::vector<double> residuals;
+    for (auto res_block : res_blocks) {
+        auto cost_function = problem.GetCostFunctionForResidualBlock(res_block);
+        auto loss_function = problem.GetLossFunctionForResidualBlock(res_block);
+        problem.GetParameterBlocksForResidualBlock(res_block, &states);
+
+        //Blocks with all states held constant, e.g. boundary neighbors, are not part of this solve
+        bool all_constant = true;
+        for (auto state : states) {
+            if (!problem.IsParameterBlockConstant(state)) {
+                all_constant = false;
+                break;
+            }
+        }
+        if (all_constant) {
+            continue;
+        }
+
+        int type = FactorStats::Frame;
+        if (dynamic_cast<const HorizonCost*>(cost_function) != nullptr) {
+            type = FactorStats::Horizon;
+        } else if (dynamic_cast<const LoopCost*>(cost_function) != nullptr) {
+            type = FactorStats::Loop;
+        } else if (dynamic_cast<const DetectionCost*>(cost_function) != nullptr) {
+            type = FactorStats::Detection;
+        } else if (dynamic_cast<const ConsensusCost*>(cost_function) != nullptr) {
+            type = FactorStats::Consensus;
+        }
+
+        int res_num = cost_function->num_residuals();
+        residuals.resize(res_num);
+        if (res_num == 0 || !cost_function->Evaluate(states.data(), residuals.data(), nullptr)) {
+            continue;
+        }
+
+        double sq_norm = 0;
+        for (double r : residuals) {
+            sq_norm += r*r;
+        }
+        double rho[3] = {sq_norm, 1, 0};
+        if (loss_function != nullptr) {
+            loss_function->Evaluate(sq_norm, rho);
+        }
+
+        if (type == FactorStats::Frame) {
+            //Robust loss is applied on the whole frame, share its cost among distance residuals by their squared error
+            auto it = sf_errors.find(cost_function);
+            if (it == sf_errors.end()) {
+                continue;
+            }
+            auto pairs = it->second->residual_pairs();
+            if ((int)pairs.size() != res_num) {
+                continue;
+            }
+            for (int i = 0; i < res_num; i++) {
+                int id_a = std::min(pairs[i].first, pairs[i].second);
+                int id_b = std::max(pairs[i].first, pairs[i].second);
+                double sq = residuals[i]*residuals[i];
+                double cost = sq_norm > 0 ? rho[0] / 2 * sq / sq_norm : 0;
+                auto & stats = factor_stats[std::make_tuple(type, id_a, id_b)];
+                stats.type = type;
+                stats.id_a = id_a;
+                stats.id_b = id_b;
+                stats.add(cost, fabs(residuals[i]), rho[1]);
+            }
+            continue;
+        }
+
+        int id_a = -1, id_b = -1;
+        if (state_ids.find(states.front()) != state_ids.end() &&
+            state_ids.find(states.back()) != state_ids.end()) {
+            id_a = state_ids.at(states.front());
+            id_b = state_ids.at(states.back());
+            if (id_a > id_b) {
+                std::swap(id_a, id_b);
+            }
+        }
+
+        auto key = std::make_tuple(type, id_a, id_b);
+        auto & stats = factor_stats[key];
+        stats.type = type;
+        stats.id_a = id_a;
+        stats.id_b = id_b;
+        stats.add(rho[0] / 2, sqrt(sq_norm / res_num), rho[1]);
+    }
+}
+
+double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, bool report, bool dense_only) {
 
     ros::Time t1 = ros::Time::now();
     Problem problem;
@@ -1792,11 +2412,13 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
     has_new_keyframe = false;
     detection_in_keyframes = 0;
     std::vector<std::pair<int64_t, int>> param_indexs;
+    SFErrorMap sf_errors;
     cutting_edges();
+    apply_boundary_states(swarm_est_poses);
 
     for (unsigned int i = 0; i < sf_sld_win.size(); i++ ) {
         // ROS_INFO()
-        detection_in_keyframes = this->setup_problem_with_sferror(swarm_est_poses, problem, sf_sld_win[i], param_indexs, i==sf_sld_win.size()-1);
+        detection_in_keyframes = this->setup_problem_with_sferror(swarm_est_poses, problem, sf_sld_win[i], param_indexs, i==sf_sld_win.size()-1, sf_errors);
     }
 
     int num_res_blks_sf = problem.NumResidualBlocks();
@@ -1805,6 +2427,10 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
     num_res_blks_sf = problem.NumResidualBlocks();
 
     for (int _id: all_nodes) {
+        if (boundary_ids.find(_id) != boundary_ids.end()) {
+            //Poses of neighbor are held constant, no need for its vo residuals
+            continue;
+        }
         this->setup_problem_with_sfherror(est_poses_idts, problem, _id);       
     }
 
@@ -1812,6 +2438,37 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
 
     num_res_sf = problem.NumResiduals();
     setup_problem_with_loops(est_poses_idts, problem);
+    setup_problem_with_consensus(est_poses_idts, problem);
+    setup_problem_parameterization(swarm_est_poses, problem);
+
+    for (int _id : boundary_ids) {
+        for (auto it : est_poses_idts.at(_id)) {
+            if (problem.HasParameterBlock(it.second)) {
+                problem.SetParameterBlockConstant(it.second);
+            }
+        }
+    }
+
+    if (!boundary_ids.empty()) {
+        ROS_INFO("Decentralized solve: %ld neighbors held as boundary", boundary_ids.size());
+    }
+
+    if (!admitting_ids.empty()) {
+        //Admission of new drones, existing solution is held fixed
+        for (auto & it : swarm_est_poses) {
+            for (auto it2 : it.second) {
+                if (admitting_ids.find(it2.first) == admitting_ids.end() && problem.HasParameterBlock(it2.second)) {
+                    problem.SetParameterBlockConstant(it2.second);
+                }
+            }
+        }
+    }
+
+    if (dense_only) {
+        //Residuals only on fixed states are dropped by ceres, so dense solve cost grows with dense window only
+        int fixed_num = fix_sparse_states(swarm_est_poses, problem);
+        ROS_INFO("Dense solve on last %d keyframes, %d sparse states fixed", dense_frame_number, fixed_num);
+    }
 
     ROS_INFO("Loop residual blocks %d residual nums %d", problem.NumResidualBlocks() - num_res_blks_sf, problem.NumResiduals() - num_res_sf);
     num_res_sf = problem.NumResiduals();
@@ -1831,6 +2488,9 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
     if (finish_init) {
         options.max_solver_time_in_seconds = max_solver_time;
         options.max_num_iterations = 1000;
+        if (!dense_only && global_solve_interval > 0) {
+            options.max_solver_time_in_seconds = global_solver_time;
+        }
     }
     
     options.num_threads = thread_num;
@@ -1843,6 +2503,9 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
 
 
     if (summary.termination_type == ceres::TerminationType::FAILURE) {
+        if (!params.exit_on_failure) {
+            throw std::runtime_error("Ceres critical failure: " + summary.message);
+        }
         ROS_ERROR("Ceres critical failure. Exiting...");
         exit(-1);
     }
@@ -1858,6 +2521,10 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
         return equv_cost;
     }
 
+    if (enable_factor_stats && finish_init) {
+        evaluate_factor_stats(est_poses_idts, problem, sf_errors);
+    }
+
     std::cout << "\nSize:" << sliding_window_size() << "\n" << summary.BriefReport() << " Equv cost : "
               << equv_cost << " Time : " << summary.total_time_in_seconds * 1000 << "ms\n";
     std::cout << summary.message << std::endl;
@@ -1942,76 +2609,49 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
 
 
 void SwarmLocalizationSolver::generate_cgraph() {
+    if (exporter == nullptr) {
+        return;
+    }
+    //Only snapshot the graph here, exporter writes it in background
     auto start = high_resolution_clock::now();
-    Agraph_t *g;
-    g = agopen("G", Agdirected, NULL);
-    char node_name[100] = {0};
-    char edgename[100] = {0};
-
-    agattr(g,AGRAPH,"shape","box");
-    agattr(g,AGRAPH,"style","filled");
-    agattr(g,AGRAPH,"label","Pose Graphs");
-    agattr(g,AGNODE,"style","filled");
-    agattr(g,AGEDGE,"color","black");
-    agattr(g,AGEDGE,"label","residual");
-
-    std::map<int64_t, std::map<int, Agnode_t*>> AGNodes;
-    
+    PoseGraphSnapshot snapshot;
+
     for (auto & sf : sf_sld_win) {
-        sprintf(node_name, "cluster_%d", TSShort(sf.ts));
-        auto sub_graph = agsubg(g, node_name, 1);
-        //	style=filled;
-        //   color=lightgrey;
-        // label = "process #1";
-        auto t = ros::Time();
-        t.fromNSec(sf.ts);
-        sprintf(node_name, "SwarmFrame %f", t.toSec());
-        agattrsym (sub_graph, "label");
-        agset (sub_graph, "label", node_name);
-
-
-        AGNodes[sf.ts] = std::map<int, Agnode_t*>();
+        snapshot.frames.push_back(sf.ts);
         for (auto & _it : sf.id2nodeframe) {
-            int _id = _it.first;
-            NodeFrame & _nf = _it.second;
-            sprintf(node_name, "Node%d_%d", _id, TSShort(sf.ts));
-            auto ag_node = agnode(sub_graph, node_name, 1);
-            AGNodes[sf.ts][_id] = ag_node;
+            PoseGraphSnapshot::Vertex v;
+            v.ts = sf.ts;
+            v.id = _it.first;
+            v.pose = get_estimated_pose(v.id, sf.ts).second;
+            snapshot.vertices.push_back(v);
         }
     }
-    std::vector<double*> pose_win;
 
     //Add all vio residuals
     for (auto _id : all_nodes) {
-        // ROS_INFO("Gen edge for node %d", _id);
-        auto nfs = est_poses_idts.at(_id);
-        Agnode_t * node1 = nullptr;
+        auto & nfs = est_poses_idts.at(_id);
+        std::vector<double*> pose_win;
+        int64_t last_ts = -1;
 
         for (const SwarmFrame & sf : sf_sld_win) {
             int64_t ts = sf.ts;
-            // ROS_INFO("Gen edge for node %d", _id);
             if (nfs.find(ts) != nfs.end()) {
-                // ROS_INFO("NFS can find ts %d", TSShort(ts));
-                auto _p = nfs[ts];
+                auto _p = nfs.at(ts);
                 if (pose_win.size() < 1 || pose_win[pose_win.size()-1] != _p) {
-                    pose_win.push_back(nfs[ts]);
-                    if (node1 == nullptr) {
-                        node1 = AGNodes[ts][_id];
-                    } else {
-                        auto node2 = AGNodes[ts][_id];
-                        auto edge = agedge(g, node1, node2, "VIO",1);
-                        agattrsym (edge, "label");
-                        Swarm::Pose dp = Swarm::Pose::DeltaPose(
+                    pose_win.push_back(_p);
+                    if (last_ts >= 0) {
+                        PoseGraphSnapshot::Edge e;
+                        e.type = PoseGraphSnapshot::VIO;
+                        e.id_a = e.id_b = _id;
+                        e.ts_a = last_ts;
+                        e.ts_b = ts;
+                        e.rel_pose = Swarm::Pose::DeltaPose(
                             Swarm::Pose(pose_win[pose_win.size()-2], true), 
                             Swarm::Pose(pose_win.back(), true)
                         );
-                        sprintf(edgename, "VIO:RP:[%3.2f,%3.2f,%3.2f],%4.3fdeg", dp.pos().x(), dp.pos().y(), dp.pos().z(),
-                            dp.yaw()*57.3);
-                        agset(edge, "label", edgename);
-
-                        // printf("Adding edge...\n");
-                        node1 = node2;
+                        snapshot.edges.push_back(e);
                     }
+                    last_ts = ts;
                 }
             } 
         }
@@ -2022,84 +2662,47 @@ void SwarmLocalizationSolver::generate_cgraph() {
         for (auto & it : sf.id2nodeframe) {
             auto & nf = it.second;
             for (auto & detected: nf.detected_nodes) {
-                auto _ida = detected.id_a;
-                auto _idb = detected.id_b;
-                auto node1 = AGNodes[ts][_ida];
-                auto node2 = AGNodes[ts][_idb];
-
-                auto edge = agedge(g, node1, node2, "Det",1);
-                agattrsym (edge, "label");
-                sprintf(edgename, "Detected");
-                agset(edge, "label", edgename);
+                PoseGraphSnapshot::Edge e;
+                e.type = PoseGraphSnapshot::FrameDetection;
+                e.ts_a = e.ts_b = ts;
+                e.id_a = detected.id_a;
+                e.id_b = detected.id_b;
+                snapshot.edges.push_back(e);
             }
 
             for (auto & it: nf.dis_map) {
                 int _idj = it.first;
                 if(sf.node_id_list.find(_idj) != sf.node_id_list.end() &&
                     nf.distance_available(_idj)) {
-                    auto _ida = nf.id;
-                    auto node1 = AGNodes[ts][_ida];
-                    auto node2 = AGNodes[ts][_idj];
-
-                    auto edge = agedge(g, node1, node2, "Dis",1);
-                    agattrsym (edge, "label");
-                    sprintf(edgename, "Dis %3.2f", it.second);
-                    agset(edge, "label", edgename);
+                    PoseGraphSnapshot::Edge e;
+                    e.type = PoseGraphSnapshot::Distance;
+                    e.ts_a = e.ts_b = ts;
+                    e.id_a = nf.id;
+                    e.id_b = _idj;
+                    e.distance = it.second;
+                    snapshot.edges.push_back(e);
                 }
             }
         }
     }
 
-
-    //
-    int count = 0;
     for (auto & _loop: good_2drone_measurements) {
-        if (_loop->meaturement_type == Swarm::GeneralMeasurement2Drones::Loop)
-        {
-            auto loop = static_cast<Swarm::LoopConnection * >(_loop);
-            
-            sprintf(edgename, "loop(%d->%d dt %4.1fms); DP [%3.2f,%3.2f,%3.2f] DY %4.3f", 
-                loop->id_a, loop->id_b, (loop->ts_b - loop->ts_a)/1000000.0,
-                loop->relative_pose.pos().x(),
-                loop->relative_pose.pos().y(),
-                loop->relative_pose.pos().z(),
-                loop->relative_pose.yaw()*57.3
-            );
-
-            // sprintf(edgename, "loop(%d->%d T:%4.1fs)", loop->id_a, loop->id_b, (loop->ts_b - loop->ts_a)/1e9);
-
-            char loopname[10] = {0};
-            sprintf(loopname, "Loop %d", count);
-            auto edge = agedge(g, AGNodes[loop->ts_a][loop->id_a], AGNodes[loop->ts_b][loop->id_b], loopname, 1);
-            agattrsym (edge, "label");
-            agattrsym (edge, "color");
-            agset(edge, "label", edgename);
-            agset(edge, "color", "orange");
-
-            count += 1;
+        PoseGraphSnapshot::Edge e;
+        e.id_a = _loop->id_a;
+        e.ts_a = _loop->ts_a;
+        e.id_b = _loop->id_b;
+        e.ts_b = _loop->ts_b;
+        if (_loop->meaturement_type == Swarm::GeneralMeasurement2Drones::Loop) {
+            e.type = PoseGraphSnapshot::Loop;
+            e.rel_pose = static_cast<Swarm::LoopConnection * >(_loop)->relative_pose;
         } else {
-            auto det = static_cast<Swarm::DroneDetection * >(_loop);
-            sprintf(edgename, "Detection(%d->%d)",
-                det->id_a, det->id_b);
-
-            char loopname[10] = {0};
-            sprintf(loopname, "Det %d", count);
-            auto edge = agedge(g, AGNodes[det->ts_a][det->id_a], AGNodes[det->ts_b][det->id_b], loopname, 1);
-            agattrsym (edge, "label");
-            agattrsym (edge, "color");
-            agset(edge, "label", edgename);
-            agset(edge, "color", "orange");
-
-            count += 1;
-        }
-    }
-    FILE * f = fopen(cgraph_path.c_str(), "w");
-    agwrite(g,f);
-    agclose(g);
-    fclose(f);
-    ROS_INFO("Generated cgraph to %s", cgraph_path.c_str());
-    double dt = duration_cast<microseconds>(high_resolution_clock::now() - start).count()/1000.0;
+            e.type = PoseGraphSnapshot::Detection;
+        }
+        snapshot.edges.push_back(e);
+    }
 
-    ROS_INFO("Generate cgraph cost %4.3fms\n", dt);
+    exporter->submit(std::move(snapshot));
+    double dt = duration_cast<microseconds>(high_resolution_clock::now() - start).count()/1000.0;
 
+    ROS_INFO("Snapshot pose graph cost %4.3fms\n", dt);
 }
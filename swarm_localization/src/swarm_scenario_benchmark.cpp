@@ -0,0 +1,252 @@
+#include "ros/ros.h"
+#include <chrono>
+#include <fstream>
+#include <string>
+#include "swarm_localization/swarm_localization_solver.hpp"
+#include "swarm_localization/swarm_msg_convert.hpp"
+#include "swarm_localization/swarm_scenario_generator.hpp"
+
+using namespace std::chrono;
+
+//Read a field like VmRSS or VmHWM of this process in MB
+double proc_status_mb(const std::string & field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, field.size(), field) == 0) {
+            return std::stod(line.substr(field.size() + 1)) / 1024.0;
+        }
+    }
+    return -1;
+}
+
+//Reset VmHWM to current VmRSS, so peak of each scenario is measured on its own
+void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+struct BenchmarkResult {
+    int solve_num = 0;
+    double solve_avg_ms = 0;
+    double solve_max_ms = 0;
+    //Growth of peak resident memory during this scenario
+    double rss_mb = 0;
+    bool failed = false;
+    double pos_rmse = 0;
+    double yaw_rmse = 0;
+    int eval_num = 0;
+    //Residual statistics of all solves, merged by factor type
+    std::map<int, FactorStats> factor_stats;
+};
+
+BenchmarkResult run_scenario(const swarm_scenario_params & scenario_params, swarm_localization_solver_params solver_params, double solve_freq) {
+    BenchmarkResult ret;
+    reset_peak_rss();
+    double rss_start = proc_status_mb("VmRSS:");
+    SwarmScenarioGenerator generator(scenario_params, ros::Time::now());
+    auto node_defs = generator.create_node_defs();
+    auto solver = new SwarmLocalizationSolver(solver_params);
+    solver->self_id = generator.drone_ids()[0];
+
+    swarm_msgs::swarm_frame _sf;
+    std::vector<swarm_msgs::LoopConnection> loops;
+    double t_last_solve = 0;
+    double solve_sum_ms = 0;
+
+    while (ros::ok() && generator.step(_sf, loops)) {
+        solver->add_new_swarm_frame(swarm_frame_from_msg(node_defs, _sf));
+        for (auto & loop : loops) {
+            solver->add_new_loop_connection(loop);
+        }
+
+        double t_now = _sf.header.stamp.toSec();
+        if (t_now - t_last_solve > 1 / solve_freq) {
+            t_last_solve = t_now;
+            auto t1 = high_resolution_clock::now();
+            double cost = -1;
+            try {
+                cost = solver->solve();
+            } catch (const std::runtime_error & e) {
+                ROS_ERROR("Scenario failed: %s", e.what());
+                ret.failed = true;
+                break;
+            }
+            double dt = duration_cast<microseconds>(high_resolution_clock::now() - t1).count() / 1000.0;
+            if (cost >= 0) {
+                ret.solve_num ++;
+                solve_sum_ms += dt;
+                ret.solve_max_ms = std::max(ret.solve_max_ms, dt);
+                for (auto & it : solver->factor_stats) {
+                    auto & stats = ret.factor_stats[it.second.type];
+                    stats.type = it.second.type;
+                    stats.merge(it.second);
+                }
+                solver->factor_stats.clear();
+            }
+        }
+    }
+
+    if (ret.solve_num > 0) {
+        ret.solve_avg_ms = solve_sum_ms / ret.solve_num;
+    }
+    if (!ret.failed) {
+        ret.eval_num = generator.evaluate(solver->kf_pathes, solver->self_id, ret.pos_rmse, ret.yaw_rmse);
+    }
+    ret.rss_mb = proc_status_mb("VmHWM:") - rss_start;
+
+    delete solver;
+    for (auto it : node_defs) {
+        delete it.second;
+    }
+    return ret;
+}
+
+//Publish the scenario in real time to the topics of localization proxy and swarm loop, for feeding a running swarm_localization_node
+void publish_scenario(ros::NodeHandle & nh, const swarm_scenario_params & scenario_params, const std::string & nodes_config_output) {
+    SwarmScenarioGenerator generator(scenario_params, ros::Time::now());
+    if (!nodes_config_output.empty()) {
+        YAML::Node config;
+        config["nodes"] = generator.nodes_config();
+        std::ofstream fout(nodes_config_output);
+        fout << config;
+        ROS_INFO("Write swarm nodes config to %s", nodes_config_output.c_str());
+    }
+
+    auto sf_pub = nh.advertise<swarm_msgs::swarm_frame>("/swarm_drones/swarm_frame", 10);
+    auto sf_predict_pub = nh.advertise<swarm_msgs::swarm_frame>("/swarm_drones/swarm_frame_predict", 10);
+    auto loop_pub = nh.advertise<swarm_msgs::LoopConnection>("/swarm_loop/loop_connection", 10);
+
+    swarm_msgs::swarm_frame _sf;
+    std::vector<swarm_msgs::LoopConnection> loops;
+    ros::Rate rate(scenario_params.frame_rate);
+    while (ros::ok() && generator.step(_sf, loops)) {
+        sf_pub.publish(_sf);
+        sf_predict_pub.publish(_sf);
+        for (auto & loop : loops) {
+            loop_pub.publish(loop);
+        }
+        ros::spinOnce();
+        rate.sleep();
+    }
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "swarm_scenario_benchmark");
+    ros::NodeHandle nh("~");
+
+    swarm_scenario_params scenario_params;
+    swarm_localization_solver_params solver_params;
+    std::vector<int> drone_nums;
+    std::vector<int> window_sizes;
+    double solve_freq;
+    bool publish_messages;
+    bool print_factor_stats;
+    std::string nodes_config_output;
+
+    nh.param<std::vector<int>>("drone_nums", drone_nums, {2, 5, 10, 20, 50});
+    nh.param<std::vector<int>>("window_sizes", window_sizes, {10, 50, 100, 200});
+    nh.param<double>("solve_freq", solve_freq, 1.0);
+    nh.param<bool>("publish_messages", publish_messages, false);
+    nh.param<bool>("print_factor_stats", print_factor_stats, false);
+    //Evaluation of factors is part of solve time, only enable it when asked
+    solver_params.enable_factor_stats = print_factor_stats;
+    //A failed solve is reported for its scenario instead of ending the sweep
+    solver_params.exit_on_failure = false;
+    nh.param<std::string>("nodes_config_output", nodes_config_output, "");
+
+    nh.param<double>("frame_rate", scenario_params.frame_rate, 10.0);
+    nh.param<double>("duration", scenario_params.duration, 120.0);
+    nh.param<double>("speed", scenario_params.speed, 1.0);
+    nh.param<double>("area_radius", scenario_params.area_radius, 10.0);
+    nh.param<double>("vo_drift_xyz", scenario_params.vo_drift_xyz, 0.02);
+    nh.param<double>("vo_drift_yaw", scenario_params.vo_drift_yaw, 0.002);
+    nh.param<double>("range_std", scenario_params.range_std, 0.1);
+    nh.param<double>("range_dropout", scenario_params.range_dropout, 0.1);
+    nh.param<double>("range_max", scenario_params.range_max, 50.0);
+    nh.param<double>("detection_range", scenario_params.detection_range, 5.0);
+    nh.param<double>("detection_prob", scenario_params.detection_prob, 0.05);
+    nh.param<double>("loop_freq", scenario_params.loop_freq, 0.1);
+    nh.param<double>("loop_max_distance", scenario_params.loop_max_distance, 1.0);
+    nh.param<int>("seed", scenario_params.seed, 0);
+
+    nh.param<int>("min_keyframe_num", solver_params.min_frame_number, 3);
+    nh.param<int>("dense_keyframe_num", solver_params.dense_frame_number, 20);
+    nh.param<float>("global_solve_interval", solver_params.global_solve_interval, 0.0f);
+    nh.param<float>("global_solver_time", solver_params.global_solver_time, 1.0f);
+    nh.param<float>("pcm_threshold", solver_params.pcm_threshold, 3.0f);
+    //Frames are fed as fast as possible, so ingest lag is meaningless here
+    solver_params.max_kf_movement_scale = 1.0;
+    nh.param<float>("max_accept_cost", solver_params.acpt_cost, 100.0f);
+    nh.param<float>("min_kf_movement", solver_params.kf_movement, 0.5f);
+    nh.param<float>("init_xy_movement", solver_params.init_xy_movement, 2.0f);
+    nh.param<float>("init_z_movement", solver_params.init_z_movement, 0.5f);
+    nh.param<int>("thread_num", solver_params.thread_num, 1);
+    nh.param<float>("max_solver_time", solver_params.max_solver_time, 0.5f);
+    nh.param<bool>("enable_detection", solver_params.enable_detection, true);
+    nh.param<bool>("enable_loop", solver_params.enable_loop, true);
+    nh.param<bool>("enable_distance", solver_params.enable_distance, true);
+    nh.param<bool>("enable_detection_depth", solver_params.enable_detection_depth, true);
+    nh.param<bool>("kf_use_all_nodes", solver_params.kf_use_all_nodes, true);
+    nh.param<bool>("decentralized", solver_params.decentralized, false);
+    solver_params.generate_full_path = false;
+    solver_params.enable_cgraph_generation = false;
+    solver_params.loop_outlier_threshold_pos = 0.5;
+    solver_params.loop_outlier_threshold_yaw = 0.5;
+    solver_params.loop_outlier_threshold_distance = 1.8;
+    solver_params.loop_outlier_threshold_distance_init = 1.8;
+    solver_params.det_dpos_thres = 0.2;
+    solver_params.detection_outlier_thres = 0.5;
+    solver_params.detection_inv_dep_outlier_thres = 0.5;
+    solver_params.distance_outlier_threshold = 1.0;
+    solver_params.distance_height_outlier_threshold = 1.0;
+
+    VO_METER_STD_TRANSLATION = scenario_params.vo_drift_xyz;
+    VO_METER_STD_Z = scenario_params.vo_drift_xyz;
+    VO_METER_STD_ANGLE = scenario_params.vo_drift_yaw;
+    DISTANCE_STD = scenario_params.range_std;
+    LOOP_POS_STD_0 = 0.6;
+    LOOP_POS_STD_SLOPE = 0.5;
+    LOOP_YAW_STD_0 = 0.05;
+    LOOP_YAW_STD_SLOPE = 0.1;
+    DETECTION_SPHERE_STD = 0.01;
+    DETECTION_INV_DEP_STD = 0.07;
+    DETECTION_DEP_STD = 0.08;
+    CG = Eigen::Vector3d::Zero();
+
+    if (publish_messages) {
+        scenario_params.drone_num = drone_nums[0];
+        publish_scenario(nh, scenario_params, nodes_config_output);
+        return 0;
+    }
+
+    printf("DRONES WINDOW SOLVES AVG_MS MAX_MS DRSS_MB POS_RMSE YAW_RMSE_DEG EVAL_NUM\n");
+    for (int drone_num : drone_nums) {
+        for (int window_size : window_sizes) {
+            scenario_params.drone_num = drone_num;
+            solver_params.max_frame_number = window_size;
+            auto ret = run_scenario(scenario_params, solver_params, solve_freq);
+            if (ret.failed) {
+                printf("%6d %6d FAILED after %d solves\n", drone_num, window_size, ret.solve_num);
+                fflush(stdout);
+                continue;
+            }
+            printf("%6d %6d %6d %6.1f %6.1f %6.1f %8.3f %12.2f %8d\n", drone_num, window_size, ret.solve_num,
+                ret.solve_avg_ms, ret.solve_max_ms, ret.rss_mb, ret.pos_rmse, ret.yaw_rmse*57.3, ret.eval_num);
+            if (print_factor_stats) {
+                //Counts and costs are summed over all solves
+                for (auto & it : ret.factor_stats) {
+                    auto & stats = it.second;
+                    printf("# FACTOR %12s COUNT %8d COST %12.2f ERR_MEAN %6.3f ERR_MAX %8.3f WEIGHT_MEAN %5.3f DOWNWEIGHTED %6.2f%%\n",
+                        FactorStats::type_name(stats.type).c_str(), stats.count, stats.cost, stats.error_mean(), stats.error_max,
+                        stats.weight_mean(), 100.0 * stats.downweighted / stats.count);
+                }
+            }
+            fflush(stdout);
+            if (!ros::ok()) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
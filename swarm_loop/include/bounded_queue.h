@@ -0,0 +1,92 @@
+#pragma once
+
+#include <deque>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+
+//Blocking queue between pipeline stages. Items pushed as droppable are bounded by max_size, when full push drops
+//the oldest droppable item in queue or the new item by drop_oldest. Other items are never dropped and not counted.
+template<typename T>
+class BoundedQueue {
+    std::deque<std::pair<T, bool>> queue;
+    std::mutex lock;
+    std::condition_variable cv;
+    size_t max_size;
+    bool drop_oldest;
+    bool closed = false;
+    int dropped = 0;
+    size_t droppable_num = 0;
+
+public:
+    BoundedQueue(size_t _max_size = 2, bool _drop_oldest = true):
+        max_size(_max_size), drop_oldest(_drop_oldest) {
+    }
+
+    void configure(size_t _max_size, bool _drop_oldest) {
+        std::lock_guard<std::mutex> guard(lock);
+        max_size = _max_size;
+        drop_oldest = _drop_oldest;
+    }
+
+    //Return false if an item is dropped
+    bool push(const T & item, bool droppable = true) {
+        bool ret = true;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (closed) {
+                return false;
+            }
+            if (droppable && droppable_num >= max_size) {
+                dropped ++;
+                ret = false;
+                if (!drop_oldest) {
+                    return false;
+                }
+                for (auto it = queue.begin(); it != queue.end(); it++) {
+                    if (it->second) {
+                        queue.erase(it);
+                        droppable_num --;
+                        break;
+                    }
+                }
+            }
+            queue.emplace_back(item, droppable);
+            if (droppable) {
+                droppable_num ++;
+            }
+        }
+        cv.notify_one();
+        return ret;
+    }
+
+    //Block until an item is available, return false when queue is closed
+    bool pop(T & item) {
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [&] {
+            return closed || !queue.empty();
+        });
+        if (queue.empty()) {
+            return false;
+        }
+        item = std::move(queue.front().first);
+        if (queue.front().second) {
+            droppable_num --;
+        }
+        queue.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+    int dropped_num() {
+        std::lock_guard<std::mutex> guard(lock);
+        return dropped;
+    }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <opencv2/core/types.hpp>
+#include "loop_defines.h"
+
+//Brute force matcher of FEATURE_DESC_SIZE float descriptors (SuperPoint) with mutual nearest neighbour check and ratio test,
+//gives the same matches as cv::BFMatcher(cv::NORM_L2, true) when ratio test is disabled.
+//Squared L2 distances are computed by inner products with AVX2 (checked at runtime) or NEON kernels, optionally on int8 quantized descriptors.
+//Buffers are kept between calls, so a matcher should not be shared between threads.
+class FeatureMatcher {
+    bool int8_mode;
+    double ratio;
+
+    std::vector<float> dists;
+    std::vector<float> norms_a, norms_b;
+    std::vector<int8_t> quant_a, quant_b;
+    std::vector<float> scales_a, scales_b;
+    std::vector<int32_t> dots;
+    std::vector<int> best_b;
+    std::vector<float> best_dist_b;
+
+    void compute_distances(const float * desc_a, int num_a, const float * desc_b, int num_b);
+
+public:
+    //ratio >= 1 disables ratio test
+    FeatureMatcher(bool _int8_mode = false, double _ratio = 1.0);
+
+    //queryIdx of matches is index in a and trainIdx index in b, distance is L2 distance
+    void match(const float * desc_a, int num_a, const float * desc_b, int num_b, std::vector<cv::DMatch> & matches);
+
+    void match(const std::vector<float> & desc_a, const std::vector<float> & desc_b, std::vector<cv::DMatch> & matches) {
+        match(desc_a.data(), desc_a.size() / FEATURE_DESC_SIZE, desc_b.data(), desc_b.size() / FEATURE_DESC_SIZE, matches);
+    }
+};
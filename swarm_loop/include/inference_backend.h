@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+#ifdef USE_ONNXRUNTIME
+#include <onnxruntime_cxx_api.h>
+#endif
+
+struct OutputBlob {
+    std::string name;
+    uint64_t volume;
+};
+
+//Runner of loop CNNs. Input is one CV_32FC1 image of height x width, outputs are float buffers in order of output blobs.
+class InferenceBackend {
+protected:
+    int width = 400;
+    int height = 208;
+public:
+    InferenceBackend(int _width, int _height):
+        width(_width), height(_height) {
+    }
+
+    virtual ~InferenceBackend() {}
+
+    virtual void doInference(const cv::Mat & input) = 0;
+
+    //Host buffer of ith output blob, valid until next inference
+    virtual float * output(int i) = 0;
+};
+
+//CPU inference of ONNX models by OpenCV DNN. Input blob is 1x1xHxW.
+//Note OpenCV DNN follows cv::setNumThreads, which is 1 in swarm_loop, instead of threads of backend.
+class OpenCVDNNInference: public InferenceBackend {
+    cv::dnn::Net net;
+    std::string input_blob;
+    std::vector<OutputBlob> output_blobs;
+    std::vector<cv::String> output_names;
+    std::vector<cv::Mat> outputs;
+public:
+    OpenCVDNNInference(const std::string & model_path, const std::string & _input_blob, const std::vector<OutputBlob> & _output_blobs,
+        int _width, int _height);
+
+    void doInference(const cv::Mat & input) override;
+
+    float * output(int i) override {
+        return (float*) outputs[i].data;
+    }
+};
+
+#ifdef USE_ONNXRUNTIME
+//CPU inference of ONNX models by ONNX Runtime, which also runs int8 quantized models (e.g. from onnxruntime.quantization). Input blob is 1x1xHxW.
+class ONNXRuntimeInference: public InferenceBackend {
+    Ort::Env env;
+    Ort::Session session{nullptr};
+    Ort::MemoryInfo memory_info;
+    std::string input_blob;
+    std::vector<OutputBlob> output_blobs;
+    std::vector<std::vector<float>> outputs;
+public:
+    ONNXRuntimeInference(const std::string & model_path, const std::string & _input_blob, const std::vector<OutputBlob> & _output_blobs,
+        int _width, int _height, int threads);
+
+    void doInference(const cv::Mat & input) override;
+
+    float * output(int i) override {
+        return outputs[i].data();
+    }
+};
+#endif
+
+//type is tensorrt (serialized engine), opencv or onnxruntime (.onnx models); threads is used by onnxruntime only.
+//Unavailable backends fall back to opencv, which exits if model_path is not an onnx model.
+std::unique_ptr<InferenceBackend> create_inference_backend(std::string type, const std::string & model_path,
+    const std::string & input_blob, const std::vector<OutputBlob> & output_blobs, int width, int height, int threads = 1);
@@ -15,6 +15,9 @@
 #include <vins/FlattenImages.h>
 #include "superpoint_tensorrt.h"
 #include "mobilenetvlad_tensorrt.h"
+#include "feature_matcher.h"
+#include "worker_pool.h"
+#include <mutex>
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
 
@@ -69,12 +72,20 @@ class LoopCam {
     ros::ServiceClient superpoint_client;
     CameraConfig camera_configuration;
     std::fstream fsp;
-#ifdef USE_TENSORRT
+#ifdef USE_LOOP_CNN
     SuperPointTensorRT superpoint_net;
     MobileNetVLADTensorRT netvlad_net;
 #endif
 
     bool send_img;
+
+    //Directions are processed in dir_pool. Each has its own matcher, networks are shared and locked,
+    //so inference of directions is serialized and only the rest of descriptor generation runs in parallel
+    WorkerPool dir_pool;
+    std::vector<FeatureMatcher> matchers;
+    std::mutex superpoint_lock;
+    std::mutex netvlad_lock;
+    std::mutex fsp_lock;
 public:
 
     bool show = false;
@@ -84,7 +95,10 @@ public:
         const std::string & superpoint_model, 
         std::string _pca_comp,
         std::string _pca_mean,
-        double thres, int max_kp_num, const std::string & netvlad_model, int width, int height, 
+        double thres, int max_kp_num, const std::string & netvlad_model, 
+        std::string _netvlad_pca_comp,
+        std::string _netvlad_pca_mean,
+        int width, int height, 
         int self_id, bool _send_img, ros::NodeHandle & nh);
     
     ImageDescriptor_t extractor_img_desc_deepnet(ros::Time stamp, cv::Mat img, bool superpoint_mode=false);
@@ -97,7 +111,7 @@ public:
     void encode_image(const cv::Mat & _img, ImageDescriptor_t & _img_desc);
     
     void match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, std::vector<float> _desc_up, std::vector<float> _desc_down, 
-        std::vector<int> & ids_up, std::vector<int> & ids_down);
+        std::vector<int> & ids_up, std::vector<int> & ids_down, FeatureMatcher & matcher);
 
     CameraPtr cam;
     cv::Mat cameraMatrix;
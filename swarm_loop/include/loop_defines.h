@@ -30,9 +30,13 @@ extern int MIN_LOOP_NUM;
 
 #define DEEP_DESC_SIZE 1024
 
+//Size of global descriptors in index, DEEP_DESC_SIZE by truncating raw netvlad or size of netvlad PCA
+extern int GLOBAL_DESC_SIZE;
+
 #define SEARCH_NEAREST_NUM 5
 #define ACCEPT_NONKEYFRAME_WAITSEC 5.0
 #define INIT_ACCEPT_NONKEYFRAME_WAITSEC 1.0
+#define MAX_RAW_STEREO_FRAMES 100 //Raw images waiting for odometry
 
 extern double INNER_PRODUCT_THRES;
 extern double INIT_MODE_PRODUCT_THRES;//INIT mode we can accept this inner product as similar
@@ -88,9 +92,39 @@ extern bool SEND_ALL_FEATURES;
 
 extern bool LOWER_CAM_AS_MAIN;
 
+//Normalized SuperPoint descriptors before PCA to superpoint.csv, for fitting PCA by pca.ipynb
 extern bool OUTPUT_RAW_SUPERPOINT_DESC;
+//Normalize SuperPoint descriptors per channel over keypoints as former builds, otherwise per keypoint. PCA files must be fitted with the same
+extern bool SUPERPOINT_PER_CHANNEL_NORM;
 
 extern std::string OUTPUT_PATH;
+
+extern bool OUTPUT_RAW_NETVLAD_DESC;
+
+//Global descriptor index: flat, ivf or hnsw
+extern std::string LOOP_INDEX_TYPE;
+extern int LOOP_INDEX_NLIST;
+extern int LOOP_INDEX_TRAIN_SIZE;
+extern int LOOP_INDEX_NPROBE;
+extern int LOOP_INDEX_HNSW_M;
+extern int LOOP_INDEX_PQ_M;
+//Candidates from compressed index re-ranked by full precision descriptors
+extern int LOOP_INDEX_RERANK_NUM;
+//Memory budget of loop database in MB, 0 for unbounded. Least recently matched keyframes are evicted beyond it
+extern double LOOP_DB_MAX_MB;
+//New keyframe is merged into last keyframe of same drone in database when closer than these and global descriptors more similar than LOOP_DB_DEDUP_PRODUCT
+extern double LOOP_DB_DEDUP_DIS;
+extern double LOOP_DB_DEDUP_YAW;
+extern double LOOP_DB_DEDUP_PRODUCT;
+//Local feature matching: int8 quantized kernels and ratio test (1 to disable)
+extern bool FEATURE_MATCH_INT8;
+extern double FEATURE_MATCH_RATIO;
+//Inference backend of SuperPoint and MobileNetVLAD: tensorrt, opencv or onnxruntime. Threads are used by onnxruntime
+extern std::string LOOP_CNN_BACKEND;
+extern int LOOP_CNN_THREADS;
+//Worker threads of each of the two direction pools (LoopCam and LoopDetector), 0 for serial and -1 for MAX_DIRS - 1.
+//SuperPoint and NetVLAD are single engines locked per inference, so directions only overlap their pre and post processing
+extern int DIR_WORKER_NUM;
 class TicToc
 {
   public:
@@ -7,11 +7,14 @@
 #include <swarm_msgs/ImageDescriptor_t.hpp>
 #include "loop_defines.h"
 #include <loop_cam.h>
+#include "feature_matcher.h"
+#include "worker_pool.h"
 #include <functional>
+#include <list>
 #include <swarm_msgs/Pose.h>
 #include <swarm_msgs/FisheyeFrameDescriptor_t.hpp>
 #ifdef USE_DEEPNET
-#include <faiss/IndexFlat.h>
+#include "loop_index.h"
 #else
 #include <DBoW3/DBoW3.h>
 #endif
@@ -20,12 +23,30 @@ using namespace swarm_msgs;
 
 #define REMOTE_MAGIN_NUMBER 1000000
 
+//Frame in database voted by directions of query frame, keyed by frame and direction offset
+struct LoopCandidate {
+    int64_t msg_id = -1;
+    int votes = 0;
+    double score = 0;
+    double best_distance = -1;
+    //Best matched direction pair, used as main directions of loop
+    int dir_new = -1;
+    int dir_old = -1;
+};
+
 class LoopDetector {
 
 protected:
-    faiss::IndexFlatIP local_index;
+    //One local feature matcher per direction
+    std::vector<FeatureMatcher> matchers;
+
+    WorkerPool dir_pool;
 
-    faiss::IndexFlatIP remote_index;
+    LoopIndex local_index;
+
+    LoopIndex remote_index;
+
+    std::fstream fnetvlad;
 
     std::map<int, int64_t> imgid2fisheye;
     std::map<int, int> imgid2dir;
@@ -33,6 +54,15 @@ protected:
     std::map<int64_t, FisheyeFrameDescriptor_t> fisheyeframe_database;
 
     std::map<int64_t, std::vector<cv::Mat>> msgid2cvimgs;
+
+    //Bookkeeping of bounded database: image ids of each frame, estimated bytes and LRU order of frames (front is least recently used)
+    std::map<int64_t, std::vector<int>> fisheye2imgids;
+    std::map<int64_t, size_t> fisheye2bytes;
+    size_t database_bytes = 0;
+    std::list<int64_t> lru_frames;
+    std::map<int64_t, std::list<int64_t>::iterator> lru_pos;
+    //Last frame of each drone in database, new keyframes are deduplicated against it
+    std::map<int, int64_t> drone2lastframe;
     
     std::vector<cv::Scalar> colors;
 
@@ -48,7 +78,8 @@ protected:
         std::vector<int> &new_idx,
         std::vector<cv::Point2f> &old_norm_2d,
         std::vector<cv::Point3f> &old_3d,
-        std::vector<int> &old_idx
+        std::vector<int> &old_idx,
+        FeatureMatcher & matcher
     );
 
     bool compute_correspond_features(const FisheyeFrameDescriptor_t & new_img_desc, const FisheyeFrameDescriptor_t & old_img_desc, 
@@ -85,9 +116,13 @@ protected:
 
     int add_to_database(const FisheyeFrameDescriptor_t & new_fisheye_desc);
     int add_to_database(const ImageDescriptor_t & new_img_desc);
+    bool is_duplicate_frame(const FisheyeFrameDescriptor_t & new_fisheye_desc);
+    void touch_frame(int64_t msg_id);
+    void evict_frame(int64_t msg_id);
+    void evict_over_budget();
     FisheyeFrameDescriptor_t & query_fisheyeframe_from_database(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int & direction_new, int & direction_old);
-    int query_from_database(const ImageDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, double & distance);
-    int query_from_database(const ImageDescriptor_t & new_img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & distance);
+    void query_from_database(const FisheyeFrameDescriptor_t & new_fisheye_desc, const std::vector<int> & dirs, const LoopIndex & index, 
+        bool remote_db, double thres, int max_index, std::map<std::pair<int64_t, int>, LoopCandidate> & candidates);
 
 
     std::set<int> success_loop_nodes;
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/MetaIndexes.h>
+
+//Inner product index of global descriptors with id-mapped removal.
+//type is flat, ivf, ivfsq8, ivfpq or hnsw. IVF types are trained on line: descriptors are kept in a flat index until train_size of them
+//are collected, then the IVF is trained on them and takes over. ivfsq8 and ivfpq keep only int8 or product quantized codes
+//and search by asymmetric distance, their results should be re-ranked with full precision descriptors.
+//HNSW can't remove in place, removed ids are filtered and the graph is rebuilt once they are half of the index.
+class LoopIndex {
+    std::string type;
+    int dim;
+    int nlist;
+    int train_size;
+    int nprobe;
+    int hnsw_m;
+    int pq_m;
+
+    faiss::IndexFlatIP * flat_storage = nullptr;
+    faiss::IndexIDMap2 * flat_index = nullptr;
+
+    faiss::IndexFlatIP * ivf_quantizer = nullptr;
+    faiss::IndexIVF * ivf_index = nullptr;
+
+    faiss::IndexHNSWFlat * hnsw_storage = nullptr;
+    faiss::IndexIDMap * hnsw_index = nullptr;
+    std::set<faiss::Index::idx_t> hnsw_removed;
+
+    faiss::Index::idx_t added_num = 0;
+
+    void train_ivf();
+    void create_hnsw();
+    void rebuild_hnsw();
+
+public:
+    LoopIndex(const std::string & _type, int _dim, int _nlist = 32, int _train_size = 1000, int _nprobe = 4, int _hnsw_m = 32, int _pq_m = 16);
+    ~LoopIndex();
+
+    //Return id of the descriptor, ids are increasing from 0 in order of adding
+    faiss::Index::idx_t add(const float * desc);
+
+    void remove(faiss::Index::idx_t id);
+
+    //Search n descriptors at once; labels are -1 when less than k results are available
+    void search(int n, const float * descs, int k, float * distances, faiss::Index::idx_t * labels) const;
+
+    //Number of descriptors in index
+    int size() const;
+
+    //Number of descriptors ever added, also the id of next descriptor
+    faiss::Index::idx_t total_added() const {
+        return added_num;
+    }
+
+    bool is_trained() const {
+        return ivf_index == nullptr || ivf_index->is_trained;
+    }
+
+    //Bytes of one stored descriptor, without ids and graph
+    int code_size() const {
+        return is_compressed() ? ivf_index->code_size : dim * sizeof(float);
+    }
+
+    //Distances are approximate and should be re-ranked
+    bool is_compressed() const {
+        return (type == "ivfsq8" || type == "ivfpq") && is_trained();
+    }
+
+    //Re-rank k_in results of one query by exact inner product with full precision descriptors, keep best k_out of them.
+    //get_desc returns nullptr for unknown ids, which are dropped
+    static void rerank(const float * query, int dim, int k_in, float * distances, faiss::Index::idx_t * labels, int k_out,
+        std::function<const float*(faiss::Index::idx_t)> get_desc);
+};
@@ -20,7 +20,19 @@ using namespace swarm_msgs;
 class LoopNet {
     lcm::LCM lcm;
 
+    //Written by broadcast and detect threads, read by LCM thread
     std::set<int64_t> sent_message;
+    std::mutex sent_lock;
+
+    void add_sent_message(int64_t _id) {
+        std::lock_guard<std::mutex> guard(sent_lock);
+        sent_message.insert(_id);
+    }
+
+    bool is_sent_message(int64_t _id) {
+        std::lock_guard<std::mutex> guard(sent_lock);
+        return sent_message.find(_id) != sent_message.end();
+    }
 
     double recv_period;
 
@@ -81,6 +93,6 @@ public:
     void scan_recv_packets();
 
     bool msg_blocked(int64_t _id) {
-        return blacklist.find(_id) != blacklist.end() || sent_message.find(_id) != sent_message.end();
+        return blacklist.find(_id) != blacklist.end() || is_sent_message(_id);
     }
 };
@@ -1,21 +1,41 @@
 #pragma once
 
-#ifdef USE_TENSORRT
-#include "tensorrt_generic.h"
+#ifdef USE_LOOP_CNN
+#include "inference_backend.h"
+#include <Eigen/Dense>
+
+Eigen::MatrixXf load_csv_mat_eigen(std::string csv);
+Eigen::VectorXf load_csv_vec_eigen(std::string csv);
+
+//MobileNetVLAD on an inference backend, TensorRT by default
+class MobileNetVLADTensorRT {
+    std::unique_ptr<InferenceBackend> backend;
+    int width;
+    int height;
+    //Optional PCA of global descriptor, reduced descriptor is normalized again
+    Eigen::MatrixXf pca_comp_T;
+    Eigen::RowVectorXf pca_mean;
+    bool use_pca = false;
 
-class MobileNetVLADTensorRT: public TensorRTInferenceGeneric {
 public:
     bool enable_perf;
     const int descriptor_size = 4096;
-    MobileNetVLADTensorRT(std::string engine_path, int _width, int _height, bool _enable_perf = false) : TensorRTInferenceGeneric("image:0", _width, _height), enable_perf(_enable_perf) {
-        TensorInfo outputTensorDesc;
-        outputTensorDesc.blobName = "descriptor:0";
-        outputTensorDesc.volume = descriptor_size;
-        m_InputSize = height*width;
-        m_OutputTensors.push_back(outputTensorDesc);
-        std::cout << "Trying to init TRT engine of MobileNetVLADTensorRT" << std::endl;
+    MobileNetVLADTensorRT(std::string engine_path, int _width, int _height, std::string _pca_comp = "", std::string _pca_mean = "", bool _enable_perf = false,
+        const std::string & backend_type = "tensorrt", int threads = 1) : 
+        width(_width), height(_height), enable_perf(_enable_perf) {
+        std::cout << "Trying to init MobileNetVLADTensorRT on " << backend_type << std::endl;
+        backend = create_inference_backend(backend_type, engine_path, "image:0", {{"descriptor:0", (uint64_t) descriptor_size}}, width, height, threads);
+
+        if (!_pca_comp.empty() && !_pca_mean.empty()) {
+            pca_comp_T = load_csv_mat_eigen(_pca_comp).transpose();
+            pca_mean = load_csv_vec_eigen(_pca_mean).transpose();
+            use_pca = true;
+            std::cout << "Global descriptor PCA " << pca_comp_T.rows() << "->" << pca_comp_T.cols() << std::endl;
+        }
+    }
 
-        init(engine_path);
+    int output_size() const {
+        return use_pca ? pca_comp_T.cols() : descriptor_size;
     }
 
     std::vector<float> inference(const cv::Mat & input);
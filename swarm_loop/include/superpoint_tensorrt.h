@@ -1,29 +1,53 @@
 #pragma once
 
-#ifdef USE_TENSORRT
-#include "tensorrt_generic.h"
-#include <torch/csrc/autograd/variable.h>
-#include <ATen/ATen.h>
-#include <torch/csrc/api/include/torch/types.h>
+#ifdef USE_LOOP_CNN
+#include "inference_backend.h"
 #include <Eigen/Dense>
 
 #define SP_DESC_RAW_LEN 256
-class SuperPointTensorRT: public TensorRTInferenceGeneric {
+
+//Bilinear sampling of desc_map (SP_DESC_RAW_LEN x height/8 x width/8) at keypoints as grid_sampler with zero padding and align_corners false,
+//desc is N x SP_DESC_RAW_LEN. per_channel_norm normalizes each channel over all keypoints as the former libtorch code
+//(torch::norm(desc, 2, 1) on SP_DESC_RAW_LEN x N), otherwise each keypoint is normalized to 1 as in SuperPoint.
+void sample_superpoint_descriptors(const float * desc_map, int width, int height, const std::vector<cv::Point2f> & keypoints,
+    bool per_channel_norm, std::vector<float> & desc);
+
+//SuperPoint on an inference backend, TensorRT by default
+class SuperPointTensorRT {
     Eigen::MatrixXf pca_comp_T;
     Eigen::RowVectorXf pca_mean;
+    //pca_mean * pca_comp_T, so projection is a single product on raw descriptors
+    Eigen::RowVectorXf pca_bias;
+    //Sampled and normalized raw descriptors of current frame, N x SP_DESC_RAW_LEN
+    std::vector<float> raw_desc;
+    //Thresholded heatmap as (score, y*width + x) and NMS buckets of kept pixel index, reused across frames
+    std::vector<std::pair<float, int>> candidates;
+    std::vector<int> nms_grid;
+    std::unique_ptr<InferenceBackend> backend;
+    int width;
+    int height;
 
 public:
     double thres = 0.015;
     bool enable_perf;
     int max_num = 200;
+    //PCA files and descriptors of other drones must come from the same normalization
+    bool per_channel_norm = true;
     SuperPointTensorRT(std::string engine_path, 
         std::string _pca_comp,
         std::string _pca_mean,
-        int _width, int _height, float _thres = 0.015, int _max_num = 200, bool _enable_perf = false);
+        int _width, int _height, float _thres = 0.015, int _max_num = 200, bool _enable_perf = false, 
+        const std::string & backend_type = "tensorrt", int threads = 1);
 
     void getKeyPoints(const cv::Mat & prob, float threshold, std::vector<cv::Point2f> &keypoints);
-    void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & desc, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors);
+    //desc_map is the raw descriptor output of SP_DESC_RAW_LEN x height/8 x width/8
+    void computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors);
 
     void inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors);
+
+    //Normalized descriptors of last inference before PCA, N x SP_DESC_RAW_LEN, for fitting PCA
+    const std::vector<float> & raw_descriptors() const {
+        return raw_desc;
+    }
 };
 #endif
\ No newline at end of file
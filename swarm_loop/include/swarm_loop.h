@@ -12,6 +12,8 @@
 #include <swarm_msgs/FisheyeFrameDescriptor.h>
 #include <opencv2/core/eigen.hpp>
 #include <sensor_msgs/CompressedImage.h>
+#include <atomic>
+#include "bounded_queue.h"
 
 using namespace std::chrono; 
 
@@ -25,7 +27,7 @@ protected:
     bool debug_image = false;
     double min_movement_keyframe = 0.3;
     int self_id = 0;
-    bool recived_image = false;
+    std::atomic<bool> recived_image{false};
     ros::Time last_kftime;
     Eigen::Vector3d last_keyframe_position = Eigen::Vector3d(10000, 10000, 10000);
 
@@ -40,6 +42,8 @@ protected:
 
     StereoFrame find_images_raw(const nav_msgs::Odometry & odometry);
 
+    void push_raw_stereo_frame(const StereoFrame & stereoframe);
+
     void flatten_raw_callback(const vins::FlattenImages & viokf);
 
     void stereo_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right);
@@ -55,6 +59,27 @@ protected:
     void VIOnonKF_callback(const StereoFrame & viokf);
     void VIOKF_callback(const StereoFrame & viokf, bool nonkeyframe = false);
 
+    //Keyframe pipeline: extract -> broadcast and detect stages connected by bounded queues, all stages run in callback when disabled
+    struct KeyframeJob {
+        StereoFrame frame;
+        bool nonkeyframe = false;
+    };
+
+    struct DetectJob {
+        FisheyeFrameDescriptor_t frame_desc;
+        std::vector<cv::Mat> imgs;
+    };
+
+    bool enable_pipeline = true;
+    BoundedQueue<KeyframeJob> extract_queue;
+    BoundedQueue<FisheyeFrameDescriptor_t> broadcast_queue;
+    BoundedQueue<DetectJob> detect_queue;
+    std::thread extract_thread, broadcast_thread, detect_thread;
+
+    void process_keyframe(const StereoFrame & stereoframe, bool nonkeyframe);
+    void broadcast_keyframe(FisheyeFrameDescriptor_t & frame_desc);
+    void start_pipeline(int queue_size, bool drop_oldest);
+
     void pub_node_frame(const FisheyeFrameDescriptor_t & viokf);
 
     void on_remote_frame_ros(const swarm_msgs::FisheyeFrameDescriptor & remote_img_desc);
@@ -97,6 +122,7 @@ protected:
     geometry_msgs::Pose left_extrinsic, right_extrinsic;
 public:
     SwarmLoop ();
+    virtual ~SwarmLoop();
     
 protected:
     virtual void Init(ros::NodeHandle & nh);
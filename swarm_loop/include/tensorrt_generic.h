@@ -6,6 +6,7 @@
 #include "NvInfer.h"
 #include <opencv2/opencv.hpp>
 #include <trt_utils.h>
+#include "inference_backend.h"
 
 struct TensorInfo
 {
@@ -16,7 +17,7 @@ struct TensorInfo
 };
 
 
-class TensorRTInferenceGeneric {
+class TensorRTInferenceGeneric: public InferenceBackend {
 protected:
     Logger m_Logger;
     nvinfer1::ICudaEngine* m_Engine = nullptr;
@@ -28,14 +29,20 @@ protected:
     std::vector<TensorInfo> m_OutputTensors;
     int m_BatchSize = 1;
     const std::string m_InputBlobName;
-    int width = 400;
-    int height = 208;
 public:
     TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height);
 
+    //Load engine with one gray input of height x width and float outputs
+    TensorRTInferenceGeneric(const std::string & engine_path, std::string input_blob_name, const std::vector<OutputBlob> & outputs, 
+        int _width, int _height);
+
     virtual void doInference(const unsigned char* input, const uint32_t batchSize);
 
-    virtual void doInference(const cv::Mat & input);
+    virtual void doInference(const cv::Mat & input) override;
+
+    float * output(int i) override {
+        return m_OutputTensors[i].hostBuffer;
+    }
 
     bool verifyEngine();
 
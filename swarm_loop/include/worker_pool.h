@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+//Fixed pool of worker threads for per direction jobs. parallel_for runs func(0..n-1) on workers and the calling thread
+//and returns when all are finished, so results written to slot i of outputs keep the order of directions.
+class WorkerPool {
+    std::vector<std::thread> workers;
+    std::mutex call_lock;
+    std::mutex lock;
+    std::condition_variable cv_task;
+    std::condition_variable cv_done;
+    const std::function<void(int)> * task = nullptr;
+    int task_num = 0;
+    int next_task = 0;
+    int finished = 0;
+    bool stop = false;
+
+    //Take one job of current task and run it, return false when none left
+    bool run_one(std::unique_lock<std::mutex> & guard) {
+        if (task == nullptr || next_task >= task_num) {
+            return false;
+        }
+        int i = next_task ++;
+        auto func = task;
+        guard.unlock();
+        (*func)(i);
+        guard.lock();
+        finished ++;
+        if (finished == task_num) {
+            cv_done.notify_all();
+        }
+        return true;
+    }
+
+    void worker_loop() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cv_task.wait(guard, [&] {
+                return stop || (task != nullptr && next_task < task_num);
+            });
+            if (stop) {
+                return;
+            }
+            run_one(guard);
+        }
+    }
+
+public:
+    //thread_num of 0 runs everything on calling thread
+    WorkerPool(int thread_num) {
+        for (int i = 0; i < thread_num; i++) {
+            workers.emplace_back(&WorkerPool::worker_loop, this);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        cv_task.notify_all();
+        for (auto & th : workers) {
+            th.join();
+        }
+    }
+
+    int size() const {
+        return workers.size();
+    }
+
+    void parallel_for(int n, const std::function<void(int)> & func) {
+        if (workers.empty() || n <= 1) {
+            for (int i = 0; i < n; i++) {
+                func(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> call_guard(call_lock);
+        std::unique_lock<std::mutex> guard(lock);
+        task = &func;
+        task_num = n;
+        next_task = 0;
+        finished = 0;
+        cv_task.notify_all();
+        while (run_one(guard)) {
+        }
+        cv_done.wait(guard, [&] {
+            return finished == task_num;
+        });
+        task = nullptr;
+    }
+};
@@ -0,0 +1,277 @@
+#include "feature_matcher.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATCHER_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MATCHER_NEON
+#endif
+
+//Inner products of all pairs of a and b, out is num_a x num_b
+
+static void dot_float_scalar(const float * a, int num_a, const float * b, int num_b, int dim, float * out) {
+    for (int i = 0; i < num_a; i++) {
+        const float * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const float * bj = b + j * dim;
+            float sum = 0;
+            for (int k = 0; k < dim; k++) {
+                sum += ai[k] * bj[k];
+            }
+            out[i * num_b + j] = sum;
+        }
+    }
+}
+
+static void dot_int8_scalar(const int8_t * a, int num_a, const int8_t * b, int num_b, int dim, int32_t * out) {
+    for (int i = 0; i < num_a; i++) {
+        const int8_t * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const int8_t * bj = b + j * dim;
+            int32_t sum = 0;
+            for (int k = 0; k < dim; k++) {
+                sum += ai[k] * bj[k];
+            }
+            out[i * num_b + j] = sum;
+        }
+    }
+}
+
+#ifdef MATCHER_X86
+static bool has_avx2() {
+    static bool ret = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return ret;
+}
+
+__attribute__((target("avx2,fma")))
+static inline float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuf = _mm_movehdup_ps(s);
+    s = _mm_add_ps(s, shuf);
+    shuf = _mm_movehl_ps(shuf, s);
+    s = _mm_add_ss(s, shuf);
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+static void dot_float_avx2(const float * a, int num_a, const float * b, int num_b, int dim, float * out) {
+    for (int i = 0; i < num_a; i++) {
+        const float * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const float * bj = b + j * dim;
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for (int k = 0; k < dim; k += 16) {
+                acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(ai + k), _mm256_loadu_ps(bj + k), acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(ai + k + 8), _mm256_loadu_ps(bj + k + 8), acc1);
+            }
+            out[i * num_b + j] = hsum_avx2(_mm256_add_ps(acc0, acc1));
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void dot_int8_avx2(const int8_t * a, int num_a, const int8_t * b, int num_b, int dim, int32_t * out) {
+    for (int i = 0; i < num_a; i++) {
+        const int8_t * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const int8_t * bj = b + j * dim;
+            __m256i acc = _mm256_setzero_si256();
+            for (int k = 0; k < dim; k += 16) {
+                //Widen to int16, madd gives int32 sums of pairs
+                __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(ai + k)));
+                __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(bj + k)));
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+            }
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            s = _mm_hadd_epi32(s, s);
+            s = _mm_hadd_epi32(s, s);
+            out[i * num_b + j] = _mm_cvtsi128_si32(s);
+        }
+    }
+}
+#endif
+
+#ifdef MATCHER_NEON
+static void dot_float_neon(const float * a, int num_a, const float * b, int num_b, int dim, float * out) {
+    for (int i = 0; i < num_a; i++) {
+        const float * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const float * bj = b + j * dim;
+            float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0), acc2 = vdupq_n_f32(0), acc3 = vdupq_n_f32(0);
+            for (int k = 0; k < dim; k += 16) {
+                acc0 = vmlaq_f32(acc0, vld1q_f32(ai + k), vld1q_f32(bj + k));
+                acc1 = vmlaq_f32(acc1, vld1q_f32(ai + k + 4), vld1q_f32(bj + k + 4));
+                acc2 = vmlaq_f32(acc2, vld1q_f32(ai + k + 8), vld1q_f32(bj + k + 8));
+                acc3 = vmlaq_f32(acc3, vld1q_f32(ai + k + 12), vld1q_f32(bj + k + 12));
+            }
+            float32x4_t s = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+            float32x2_t s2 = vadd_f32(vget_low_f32(s), vget_high_f32(s));
+            out[i * num_b + j] = vget_lane_f32(vpadd_f32(s2, s2), 0);
+        }
+    }
+}
+
+static void dot_int8_neon(const int8_t * a, int num_a, const int8_t * b, int num_b, int dim, int32_t * out) {
+    for (int i = 0; i < num_a; i++) {
+        const int8_t * ai = a + i * dim;
+        for (int j = 0; j < num_b; j++) {
+            const int8_t * bj = b + j * dim;
+            int32x4_t acc = vdupq_n_s32(0);
+            for (int k = 0; k < dim; k += 16) {
+                int8x16_t va = vld1q_s8(ai + k);
+                int8x16_t vb = vld1q_s8(bj + k);
+                //Sum of two int8 products fits in int16
+                int16x8_t p = vmull_s8(vget_low_s8(va), vget_low_s8(vb));
+                p = vmlal_s8(p, vget_high_s8(va), vget_high_s8(vb));
+                acc = vpadalq_s16(acc, p);
+            }
+            int32x2_t s2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+            out[i * num_b + j] = vget_lane_s32(vpadd_s32(s2, s2), 0);
+        }
+    }
+}
+#endif
+
+static void dot_float(const float * a, int num_a, const float * b, int num_b, int dim, float * out) {
+    if (dim % 16 == 0) {
+#ifdef MATCHER_X86
+        if (has_avx2()) {
+            dot_float_avx2(a, num_a, b, num_b, dim, out);
+            return;
+        }
+#endif
+#ifdef MATCHER_NEON
+        dot_float_neon(a, num_a, b, num_b, dim, out);
+        return;
+#endif
+    }
+    dot_float_scalar(a, num_a, b, num_b, dim, out);
+}
+
+static void dot_int8(const int8_t * a, int num_a, const int8_t * b, int num_b, int dim, int32_t * out) {
+    if (dim % 16 == 0) {
+#ifdef MATCHER_X86
+        if (has_avx2()) {
+            dot_int8_avx2(a, num_a, b, num_b, dim, out);
+            return;
+        }
+#endif
+#ifdef MATCHER_NEON
+        dot_int8_neon(a, num_a, b, num_b, dim, out);
+        return;
+#endif
+    }
+    dot_int8_scalar(a, num_a, b, num_b, dim, out);
+}
+
+//Symmetric quantization with one scale per descriptor
+static void quantize(const float * desc, int num, int dim, std::vector<int8_t> & quant, std::vector<float> & scales) {
+    quant.resize(num * dim);
+    scales.resize(num);
+    for (int i = 0; i < num; i++) {
+        const float * d = desc + i * dim;
+        float max_abs = 0;
+        for (int k = 0; k < dim; k++) {
+            max_abs = std::max(max_abs, std::fabs(d[k]));
+        }
+        float scale = max_abs > 0 ? max_abs / 127.0f : 1.0f;
+        for (int k = 0; k < dim; k++) {
+            quant[i * dim + k] = (int8_t) std::lround(d[k] / scale);
+        }
+        scales[i] = scale;
+    }
+}
+
+static void compute_norms(const float * desc, int num, int dim, std::vector<float> & norms) {
+    norms.resize(num);
+    for (int i = 0; i < num; i++) {
+        float sum = 0;
+        for (int k = 0; k < dim; k++) {
+            sum += desc[i * dim + k] * desc[i * dim + k];
+        }
+        norms[i] = sum;
+    }
+}
+
+FeatureMatcher::FeatureMatcher(bool _int8_mode, double _ratio):
+    int8_mode(_int8_mode), ratio(_ratio) {
+}
+
+void FeatureMatcher::compute_distances(const float * desc_a, int num_a, const float * desc_b, int num_b) {
+    const int dim = FEATURE_DESC_SIZE;
+    dists.resize(num_a * num_b);
+    compute_norms(desc_a, num_a, dim, norms_a);
+    compute_norms(desc_b, num_b, dim, norms_b);
+
+    if (int8_mode) {
+        quantize(desc_a, num_a, dim, quant_a, scales_a);
+        quantize(desc_b, num_b, dim, quant_b, scales_b);
+        dots.resize(num_a * num_b);
+        dot_int8(quant_a.data(), num_a, quant_b.data(), num_b, dim, dots.data());
+        for (int i = 0; i < num_a; i++) {
+            for (int j = 0; j < num_b; j++) {
+                dists[i * num_b + j] = dots[i * num_b + j] * scales_a[i] * scales_b[j];
+            }
+        }
+    } else {
+        dot_float(desc_a, num_a, desc_b, num_b, dim, dists.data());
+    }
+
+    //Squared L2 distance |a|^2 + |b|^2 - 2ab
+    for (int i = 0; i < num_a; i++) {
+        for (int j = 0; j < num_b; j++) {
+            float & d = dists[i * num_b + j];
+            d = std::max(norms_a[i] + norms_b[j] - 2 * d, 0.0f);
+        }
+    }
+}
+
+void FeatureMatcher::match(const float * desc_a, int num_a, const float * desc_b, int num_b, std::vector<cv::DMatch> & matches) {
+    matches.clear();
+    if (num_a == 0 || num_b == 0) {
+        return;
+    }
+
+    compute_distances(desc_a, num_a, desc_b, num_b);
+
+    best_b.assign(num_b, -1);
+    best_dist_b.assign(num_b, FLT_MAX);
+    for (int i = 0; i < num_a; i++) {
+        for (int j = 0; j < num_b; j++) {
+            if (dists[i * num_b + j] < best_dist_b[j]) {
+                best_dist_b[j] = dists[i * num_b + j];
+                best_b[j] = i;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_a; i++) {
+        int best = -1;
+        float best_dist = FLT_MAX, second_dist = FLT_MAX;
+        for (int j = 0; j < num_b; j++) {
+            float d = dists[i * num_b + j];
+            if (d < best_dist) {
+                second_dist = best_dist;
+                best_dist = d;
+                best = j;
+            } else if (d < second_dist) {
+                second_dist = d;
+            }
+        }
+
+        if (best < 0 || best_b[best] != i) {
+            continue;
+        }
+
+        //Distances are squared
+        if (ratio < 1.0 && second_dist < FLT_MAX && best_dist >= ratio * ratio * second_dist) {
+            continue;
+        }
+        matches.emplace_back(i, best, std::sqrt(best_dist));
+    }
+}
@@ -0,0 +1,114 @@
+#include "ros/ros.h"
+#include <random>
+#include <chrono>
+#include <opencv2/features2d.hpp>
+#include "loop_defines.h"
+#include "feature_matcher.h"
+
+using namespace std::chrono;
+
+//Compare FeatureMatcher with cv::BFMatcher(cv::NORM_L2, true) on random normalized descriptors.
+//Float mode must give the same matches, int8 mode reports agreement with BFMatcher.
+void random_descriptors(std::mt19937 & rng, int num, std::vector<float> & desc) {
+    std::normal_distribution<float> dist(0, 1);
+    desc.resize(num * FEATURE_DESC_SIZE);
+    for (int i = 0; i < num; i++) {
+        float * d = desc.data() + i * FEATURE_DESC_SIZE;
+        float norm = 0;
+        for (int k = 0; k < FEATURE_DESC_SIZE; k++) {
+            d[k] = dist(rng);
+            norm += d[k] * d[k];
+        }
+        norm = sqrt(norm);
+        for (int k = 0; k < FEATURE_DESC_SIZE; k++) {
+            d[k] /= norm;
+        }
+    }
+}
+
+//Some of b are noisy copies of a, so there are good matches besides random ones
+void perturbed_copies(std::mt19937 & rng, const std::vector<float> & src, int num, double noise, std::vector<float> & desc) {
+    std::normal_distribution<float> dist(0, noise);
+    int num_src = src.size() / FEATURE_DESC_SIZE;
+    for (int i = 0; i < num && i < num_src; i++) {
+        for (int k = 0; k < FEATURE_DESC_SIZE; k++) {
+            desc[i * FEATURE_DESC_SIZE + k] = src[i * FEATURE_DESC_SIZE + k] + dist(rng);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "feature_matcher_benchmark");
+    ros::NodeHandle nh("~");
+
+    int trials, num_a, num_b, seed;
+    nh.param<int>("trials", trials, 20);
+    nh.param<int>("num_a", num_a, 200);
+    nh.param<int>("num_b", num_b, 200);
+    nh.param<int>("seed", seed, 0);
+
+    std::mt19937 rng(seed);
+    cv::BFMatcher bfmatcher(cv::NORM_L2, true);
+    FeatureMatcher matcher_float(false);
+    FeatureMatcher matcher_int8(true);
+
+    int float_mismatch = 0, int8_agree = 0, bf_total = 0;
+    double max_dist_err = 0;
+    double dt_bf = 0, dt_float = 0, dt_int8 = 0;
+    std::vector<float> desc_a, desc_b;
+    for (int t = 0; t < trials; t++) {
+        random_descriptors(rng, num_a, desc_a);
+        random_descriptors(rng, num_b, desc_b);
+        perturbed_copies(rng, desc_a, std::min(num_a, num_b) / 2, 0.02, desc_b);
+
+        cv::Mat mat_a(num_a, FEATURE_DESC_SIZE, CV_32F, desc_a.data());
+        cv::Mat mat_b(num_b, FEATURE_DESC_SIZE, CV_32F, desc_b.data());
+        std::vector<cv::DMatch> bf_matches, float_matches, int8_matches;
+
+        auto t0 = high_resolution_clock::now();
+        bfmatcher.match(mat_a, mat_b, bf_matches);
+        auto t1 = high_resolution_clock::now();
+        matcher_float.match(desc_a, desc_b, float_matches);
+        auto t2 = high_resolution_clock::now();
+        matcher_int8.match(desc_a, desc_b, int8_matches);
+        auto t3 = high_resolution_clock::now();
+        dt_bf += duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+        dt_float += duration_cast<microseconds>(t2 - t1).count() / 1000.0;
+        dt_int8 += duration_cast<microseconds>(t3 - t2).count() / 1000.0;
+
+        std::map<int, cv::DMatch> bf_map;
+        for (auto & m : bf_matches) {
+            bf_map[m.queryIdx] = m;
+        }
+        bf_total += bf_matches.size();
+
+        if (float_matches.size() != bf_matches.size()) {
+            float_mismatch += abs((int)float_matches.size() - (int)bf_matches.size());
+        }
+        for (auto & m : float_matches) {
+            auto it = bf_map.find(m.queryIdx);
+            if (it == bf_map.end() || it->second.trainIdx != m.trainIdx) {
+                float_mismatch ++;
+                continue;
+            }
+            max_dist_err = std::max(max_dist_err, (double) fabs(it->second.distance - m.distance));
+        }
+        for (auto & m : int8_matches) {
+            auto it = bf_map.find(m.queryIdx);
+            if (it != bf_map.end() && it->second.trainIdx == m.trainIdx) {
+                int8_agree ++;
+            }
+        }
+    }
+
+    printf("BFMatcher %d matches %.2fms per call\n", bf_total, dt_bf / trials);
+    printf("Float     mismatch %d max distance error %.2e %.2fms per call\n", float_mismatch, max_dist_err, dt_float / trials);
+    printf("Int8      agree %d/%d %.2fms per call\n", int8_agree, bf_total, dt_int8 / trials);
+    fflush(stdout);
+
+    if (float_mismatch > 0 || max_dist_err > 1e-3) {
+        ROS_ERROR("FeatureMatcher differs from BFMatcher in float mode");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "inference_backend.h"
+#include <iostream>
+#include <cstdlib>
+#ifdef USE_TENSORRT
+#include "tensorrt_generic.h"
+#endif
+
+OpenCVDNNInference::OpenCVDNNInference(const std::string & model_path, const std::string & _input_blob, const std::vector<OutputBlob> & _output_blobs,
+    int _width, int _height):
+    InferenceBackend(_width, _height), input_blob(_input_blob), output_blobs(_output_blobs) {
+    std::cout << "Trying to init OpenCV DNN of " << model_path << std::endl;
+    net = cv::dnn::readNet(model_path);
+    if (net.empty()) {
+        std::cerr << "Unable to load " << model_path << " by OpenCV DNN" << std::endl;
+        exit(-1);
+    }
+    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    for (auto & blob : output_blobs) {
+        output_names.push_back(blob.name);
+    }
+}
+
+void OpenCVDNNInference::doInference(const cv::Mat & input) {
+    assert(input.channels() == 1 && "Only support 1 channel now");
+    cv::Mat blob = cv::dnn::blobFromImage(input);
+    net.setInput(blob, input_blob);
+    net.forward(outputs, output_names);
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (!outputs[i].isContinuous()) {
+            outputs[i] = outputs[i].clone();
+        }
+        assert(outputs[i].total() == output_blobs[i].volume && "Output volume doesn't match model");
+    }
+}
+
+#ifdef USE_ONNXRUNTIME
+ONNXRuntimeInference::ONNXRuntimeInference(const std::string & model_path, const std::string & _input_blob, const std::vector<OutputBlob> & _output_blobs,
+    int _width, int _height, int threads):
+    InferenceBackend(_width, _height),
+    env(ORT_LOGGING_LEVEL_WARNING, "swarm_loop"),
+    memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+    input_blob(_input_blob), output_blobs(_output_blobs) {
+    std::cout << "Trying to init ONNX Runtime of " << model_path << " threads " << threads << std::endl;
+    Ort::SessionOptions options;
+    options.SetIntraOpNumThreads(threads);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    session = Ort::Session(env, model_path.c_str(), options);
+    outputs.resize(output_blobs.size());
+}
+
+void ONNXRuntimeInference::doInference(const cv::Mat & input) {
+    assert(input.channels() == 1 && input.isContinuous() && "Only support 1 channel now");
+    std::vector<int64_t> input_shape{1, 1, height, width};
+    auto input_tensor = Ort::Value::CreateTensor<float>(memory_info, (float*) input.data, height * width,
+        input_shape.data(), input_shape.size());
+
+    const char * input_names[] = {input_blob.c_str()};
+    std::vector<const char*> output_names;
+    for (auto & blob : output_blobs) {
+        output_names.push_back(blob.name.c_str());
+    }
+
+    auto ret = session.Run(Ort::RunOptions{nullptr}, input_names, &input_tensor, 1, output_names.data(), output_names.size());
+    for (size_t i = 0; i < ret.size(); i++) {
+        float * data = ret[i].GetTensorMutableData<float>();
+        size_t count = ret[i].GetTensorTypeAndShapeInfo().GetElementCount();
+        assert(count == output_blobs[i].volume && "Output volume doesn't match model");
+        outputs[i].assign(data, data + count);
+    }
+}
+#endif
+
+std::unique_ptr<InferenceBackend> create_inference_backend(std::string type, const std::string & model_path,
+    const std::string & input_blob, const std::vector<OutputBlob> & output_blobs, int width, int height, int threads) {
+#ifndef USE_TENSORRT
+    if (type == "tensorrt") {
+        std::cout << "Not built with TensorRT, use OpenCV DNN" << std::endl;
+        type = "opencv";
+    }
+#endif
+#ifndef USE_ONNXRUNTIME
+    if (type == "onnxruntime") {
+        std::cout << "Not built with ONNX Runtime, use OpenCV DNN" << std::endl;
+        type = "opencv";
+    }
+#endif
+
+#ifdef USE_TENSORRT
+    if (type == "tensorrt") {
+        return std::unique_ptr<InferenceBackend>(new TensorRTInferenceGeneric(model_path, input_blob, output_blobs, width, height));
+    }
+#endif
+    //CPU backends only load onnx models, a serialized TensorRT engine given on fallback can't be used
+    const std::string onnx_ext = ".onnx";
+    if (model_path.size() < onnx_ext.size() || model_path.compare(model_path.size() - onnx_ext.size(), onnx_ext.size(), onnx_ext) != 0) {
+        std::cerr << "Inference backend " << type << " needs an onnx model, got " << model_path << std::endl;
+        exit(-1);
+    }
+#ifdef USE_ONNXRUNTIME
+    if (type == "onnxruntime") {
+        return std::unique_ptr<InferenceBackend>(new ONNXRuntimeInference(model_path, input_blob, output_blobs, width, height, threads));
+    }
+#endif
+    if (type != "opencv") {
+        std::cout << "Unknown inference backend " << type << ", use OpenCV DNN" << std::endl;
+    }
+    return std::unique_ptr<InferenceBackend>(new OpenCVDNNInference(model_path, input_blob, output_blobs, width, height));
+}
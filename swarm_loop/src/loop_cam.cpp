@@ -11,28 +11,31 @@ using namespace std::chrono;
 
 double TRIANGLE_THRES;
 
-#define USE_TENSORRT
-
 LoopCam::LoopCam(CameraConfig _camera_configuration, 
     const std::string &camera_config_path, 
     const std::string &superpoint_model, 
     std::string _pca_comp,
     std::string _pca_mean,
     double thres, int max_kp_num,
-    const std::string & netvlad_model, int width, int height, int _self_id, bool _send_img, ros::NodeHandle &nh) : 
+    const std::string & netvlad_model, 
+    std::string _netvlad_pca_comp,
+    std::string _netvlad_pca_mean,
+    int width, int height, int _self_id, bool _send_img, ros::NodeHandle &nh) : 
     camera_configuration(_camera_configuration),
     self_id(_self_id),
-#ifdef USE_TENSORRT
-    superpoint_net(superpoint_model, _pca_comp, _pca_mean, width, height, thres, max_kp_num), 
-    netvlad_net(netvlad_model, width, height), 
+#ifdef USE_LOOP_CNN
+    superpoint_net(superpoint_model, _pca_comp, _pca_mean, width, height, thres, max_kp_num, false, LOOP_CNN_BACKEND, LOOP_CNN_THREADS), 
+    netvlad_net(netvlad_model, width, height, _netvlad_pca_comp, _netvlad_pca_mean, false, LOOP_CNN_BACKEND, LOOP_CNN_THREADS), 
 #endif
-    send_img(_send_img)
+    send_img(_send_img),
+    dir_pool(DIR_WORKER_NUM),
+    matchers(MAX_DIRS, FeatureMatcher(FEATURE_MATCH_INT8, FEATURE_MATCH_RATIO))
 {
     camodocal::CameraFactory cam_factory;
     ROS_INFO("Read camera from %s", camera_config_path.c_str());
     cam = cam_factory.generateCameraFromYamlFile(camera_config_path);
 
-#ifndef USE_TENSORRT
+#ifndef USE_LOOP_CNN
     hfnet_client = nh.serviceClient<HFNetSrv>("/swarm_loop/hfnet");
     superpoint_client = nh.serviceClient<HFNetSrv>("/swarm_loop/superpoint");
 #endif
@@ -51,6 +54,13 @@ LoopCam::LoopCam(CameraConfig _camera_configuration,
     if (OUTPUT_RAW_SUPERPOINT_DESC) {
         fsp.open(OUTPUT_PATH+"superpoint.csv", std::fstream::app);
     }
+
+#ifdef USE_LOOP_CNN
+    superpoint_net.per_channel_norm = SUPERPOINT_PER_CHANNEL_NORM;
+    //Without PCA, only first DEEP_DESC_SIZE dims of netvlad are indexed as before
+    GLOBAL_DESC_SIZE = std::min(netvlad_net.output_size(), DEEP_DESC_SIZE);
+#endif
+    ROS_INFO("Global descriptor size %d", GLOBAL_DESC_SIZE);
 }
 
 void LoopCam::encode_image(const cv::Mat &_img, ImageDescriptor_t &_img_desc)
@@ -139,15 +149,10 @@ cv::Mat drawMatches(std::vector<cv::Point2f> pts1, std::vector<cv::Point2f> pts2
 }
 
 void LoopCam::match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, std::vector<float> _desc_up, std::vector<float> _desc_down, 
-        std::vector<int> & ids_up, std::vector<int> & ids_down) {
+        std::vector<int> & ids_up, std::vector<int> & ids_down, FeatureMatcher & matcher) {
     printf("match_HFNet_local_features %ld %ld: ", pts_up.size(), pts_down.size());
-    cv::Mat desc_up( _desc_up.size()/FEATURE_DESC_SIZE, FEATURE_DESC_SIZE, CV_32F, _desc_up.data());
-    cv::Mat desc_down( _desc_down.size()/FEATURE_DESC_SIZE, FEATURE_DESC_SIZE, CV_32F, _desc_down.data());
-
-    cv::BFMatcher bfmatcher(cv::NORM_L2, true);
-
     std::vector<cv::DMatch> _matches;
-    bfmatcher.match(desc_up, desc_down, _matches);
+    matcher.match(_desc_up, _desc_down, _matches);
 
     std::vector<cv::Point2f> _pts_up, _pts_down;
     std::vector<int> ids;
@@ -181,17 +186,23 @@ FisheyeFrameDescriptor_t LoopCam::on_flattened_images(const StereoFrame & msg, s
     
     imgs.resize(msg.left_images.size());
 
-    cv::Mat _show, tmp;
+    cv::Mat _show;
+    int dir_num = msg.left_images.size();
+    std::vector<cv::Mat> shows(dir_num);
+    frame_desc.images.resize(dir_num);
 
-    for (unsigned int i = 0; i < msg.left_images.size(); i ++) {
+    TicToc tic;
+    dir_pool.parallel_for(dir_num, [&](int i) {
         if (camera_configuration == CameraConfig::PINHOLE_DEPTH) {
-            frame_desc.images.push_back(generate_gray_depth_image_descriptor(msg, imgs[i], i, tmp));
-            frame_desc.images[i].direction = i;
+            frame_desc.images[i] = generate_gray_depth_image_descriptor(msg, imgs[i], i, shows[i]);
         } else {
-            frame_desc.images.push_back(generate_stereo_image_descriptor(msg, imgs[i], i, tmp));
-            frame_desc.images[i].direction = i;
+            frame_desc.images[i] = generate_stereo_image_descriptor(msg, imgs[i], i, shows[i]);
         }
+        frame_desc.images[i].direction = i;
+    });
+    ROS_INFO("Descriptors of %d directions in %.1fms with %d workers", dir_num, tic.toc(), dir_pool.size());
 
+    for (auto & tmp : shows) {
         if (_show.cols == 0) {
             _show = tmp;
         } else {
@@ -373,7 +384,7 @@ ImageDescriptor_t LoopCam::generate_stereo_image_descriptor(const StereoFrame &
     if (ides.landmarks_2d.size() > ACCEPT_MIN_3D_PTS) {
         pts_up = toCV(ides.landmarks_2d);
         pts_down = toCV(ides_down.landmarks_2d);
-        match_HFNet_local_features(pts_up, pts_down, ides.feature_descriptor, ides_down.feature_descriptor, ids_up, ids_down);
+        match_HFNet_local_features(pts_up, pts_down, ides.feature_descriptor, ides_down.feature_descriptor, ids_up, ids_down, matchers[vcam_id]);
     } else {
         return ides;
     }
@@ -521,9 +532,15 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
     cv::Mat roi = img(cv::Rect(0, img.rows*3/4, img.cols, img.rows/4));
     roi.setTo(cv::Scalar(0, 0, 0));
     }
-#ifdef USE_TENSORRT
+#ifdef USE_LOOP_CNN
     std::vector<cv::Point2f> features;
+    std::vector<float> raw_desc;
+    superpoint_lock.lock();
     superpoint_net.inference(img, features, img_des.feature_descriptor);
+    if (OUTPUT_RAW_SUPERPOINT_DESC) {
+        raw_desc = superpoint_net.raw_descriptors();
+    }
+    superpoint_lock.unlock();
     img_des.image_desc_size = 0;
     img_des.image_desc.clear();
     CVPoints2LCM(features, img_des.landmarks_2d);
@@ -535,7 +552,9 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
     img_des.image_size = 0;
 
     if (!superpoint_mode) {
+        netvlad_lock.lock();
         img_des.image_desc = netvlad_net.inference(img);
+        netvlad_lock.unlock();
         img_des.image_desc_size = img_des.image_desc.size();
     }
 
@@ -557,14 +576,18 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
         pt3d.z = 0;
         img_des.landmarks_3d.push_back(pt3d);
         img_des.landmarks_flag.push_back(0);
+    } 
 
-        if (OUTPUT_RAW_SUPERPOINT_DESC) {
-            for (int j = 0; j < FEATURE_DESC_SIZE; j ++) {
-                fsp << img_des.feature_descriptor[i*FEATURE_DESC_SIZE + j] << " ";
+    if (OUTPUT_RAW_SUPERPOINT_DESC) {
+        fsp_lock.lock();
+        for (unsigned int i = 0; i < img_des.landmarks_2d.size(); i++) {
+            for (int j = 0; j < SP_DESC_RAW_LEN; j ++) {
+                fsp << raw_desc[i*SP_DESC_RAW_LEN + j] << " ";
             }
             fsp << std::endl;
         }
-    } 
+        fsp_lock.unlock();
+    }
 
     return img_des;
 #else
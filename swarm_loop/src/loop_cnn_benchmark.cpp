@@ -0,0 +1,89 @@
+#include "ros/ros.h"
+#include <algorithm>
+#include "loop_defines.h"
+#include "superpoint_tensorrt.h"
+#include "mobilenetvlad_tensorrt.h"
+
+//Latency of SuperPoint and MobileNetVLAD on an inference backend, e.g. CPU backends on machines without CUDA.
+//Models are serialized engines for tensorrt and onnx files for opencv and onnxruntime. SuperPoint needs its PCA files.
+void print_latency(const std::string & name, std::vector<double> & dts) {
+    std::sort(dts.begin(), dts.end());
+    double sum = 0;
+    for (auto dt : dts) {
+        sum += dt;
+    }
+    printf("%-12s MEAN %7.2fms P50 %7.2fms P90 %7.2fms MAX %7.2fms\n", name.c_str(), sum / dts.size(),
+        dts[dts.size() / 2], dts[dts.size() * 9 / 10], dts.back());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "loop_cnn_benchmark");
+    ros::NodeHandle nh("~");
+
+    std::string backend, superpoint_model_path, netvlad_model_path, pca_comp_path, pca_mean_path, image_path;
+    int width, height, iterations, threads;
+    nh.param<std::string>("cnn_backend", backend, "opencv");
+    nh.param<int>("cnn_threads", threads, 1);
+    nh.param<std::string>("superpoint_model_path", superpoint_model_path, "");
+    nh.param<std::string>("netvlad_model_path", netvlad_model_path, "");
+    nh.param<std::string>("pca_comp_path", pca_comp_path, "");
+    nh.param<std::string>("pca_mean_path", pca_mean_path, "");
+    nh.param<std::string>("image_path", image_path, "");
+    nh.param<int>("width", width, 400);
+    nh.param<int>("height", height, 208);
+    nh.param<int>("iterations", iterations, 100);
+
+    cv::Mat img;
+    if (!image_path.empty()) {
+        img = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
+    }
+    if (img.empty()) {
+        ROS_WARN("No image from %s, use random image", image_path.c_str());
+        img = cv::Mat(height, width, CV_8UC1);
+        cv::randu(img, 0, 255);
+    }
+    cv::resize(img, img, cv::Size(width, height));
+    iterations = std::max(iterations, 1);
+
+    if (!superpoint_model_path.empty() && (pca_comp_path.empty() || pca_mean_path.empty())) {
+        ROS_ERROR("SuperPoint needs pca_comp_path and pca_mean_path");
+        return -1;
+    }
+
+    //Standalone process, so OpenCV DNN can take the threads; onnxruntime uses its own
+    if (backend == "opencv") {
+        cv::setNumThreads(threads);
+    }
+
+    ROS_INFO("Loop CNN benchmark on %s with %d threads, %dx%d, %d iterations", backend.c_str(), threads, width, height, iterations);
+
+    if (!superpoint_model_path.empty()) {
+        SuperPointTensorRT superpoint(superpoint_model_path, pca_comp_path, pca_mean_path, width, height, 0.012, 200, false, backend, threads);
+        std::vector<cv::Point2f> kps;
+        std::vector<float> local_desc;
+        //Warm up
+        superpoint.inference(img, kps, local_desc);
+        std::vector<double> dts;
+        for (int i = 0; i < iterations; i++) {
+            TicToc tic;
+            superpoint.inference(img, kps, local_desc);
+            dts.push_back(tic.toc());
+        }
+        print_latency("SuperPoint", dts);
+        ROS_INFO("SuperPoint gives %ld keypoints", kps.size());
+    }
+
+    if (!netvlad_model_path.empty()) {
+        MobileNetVLADTensorRT netvlad(netvlad_model_path, width, height, "", "", false, backend, threads);
+        netvlad.inference(img);
+        std::vector<double> dts;
+        for (int i = 0; i < iterations; i++) {
+            TicToc tic;
+            netvlad.inference(img);
+            dts.push_back(tic.toc());
+        }
+        print_latency("NetVLAD", dts);
+    }
+    return 0;
+}
@@ -70,6 +70,16 @@ void LoopDetector::on_image_recv(const FisheyeFrameDescriptor_t & flatten_desc,
         return;
     }
 
+    for (auto & img : flatten_desc.images) {
+        //Raw netvlad descriptors are longer and truncated by index, reduced ones must match exactly
+        bool size_ok = GLOBAL_DESC_SIZE < DEEP_DESC_SIZE ? img.image_desc.size() == GLOBAL_DESC_SIZE : img.image_desc.size() >= GLOBAL_DESC_SIZE;
+        if (img.landmark_num > 0 && !size_ok) {
+            ROS_WARN("Give up frame_desc from %d with global descriptor size %ld(%d), check PCA of netvlad on all drones", 
+                drone_id, img.image_desc.size(), GLOBAL_DESC_SIZE);
+            return;
+        }
+    }
+
     if (flatten_desc.landmark_num >= MIN_LOOP_NUM) {
         bool init_mode = false;
         if (drone_id != self_id) {
@@ -92,8 +102,16 @@ void LoopDetector::on_image_recv(const FisheyeFrameDescriptor_t & flatten_desc,
         }
 
         if (!flatten_desc.prevent_adding_db || new_node) {
-            add_to_database(flatten_desc);
-            msgid2cvimgs[flatten_desc.msg_id] = imgs;
+            if (!new_node && is_duplicate_frame(flatten_desc)) {
+                ROS_INFO("Keyframe from %d is merged into last keyframe %ld in database", drone_id, drone2lastframe[drone_id]);
+                touch_frame(drone2lastframe[drone_id]);
+            } else {
+                //Images are only used for visualization
+                if (enable_visualize) {
+                    msgid2cvimgs[flatten_desc.msg_id] = imgs;
+                }
+                add_to_database(flatten_desc);
+            }
         } else {
             ROS_INFO("This image is prevent to adding to DB");
         }
@@ -215,148 +233,290 @@ Swarm::Pose AffineRestoCamPose(Eigen::Matrix4d affine) {
     return Swarm::Pose(R, T);
 }
 
+template<typename T>
+size_t vector_bytes(const std::vector<T> & v) {
+    return v.size() * sizeof(T);
+}
+
+//Rough memory of a frame in database, including its images and descriptors in index
+size_t estimate_frame_bytes(const FisheyeFrameDescriptor_t & frame_desc, const std::vector<cv::Mat> & imgs, int index_code_size) {
+    size_t bytes = sizeof(FisheyeFrameDescriptor_t);
+    for (auto & img_desc : frame_desc.images) {
+        bytes += sizeof(ImageDescriptor_t) + vector_bytes(img_desc.image_desc) + vector_bytes(img_desc.feature_descriptor) 
+            + vector_bytes(img_desc.landmarks_2d) + vector_bytes(img_desc.landmarks_2d_norm) + vector_bytes(img_desc.landmarks_3d)
+            + vector_bytes(img_desc.landmarks_flag) + vector_bytes(img_desc.image);
+        if (img_desc.landmark_num > 0) {
+            bytes += index_code_size;
+        }
+    }
+    for (auto & img : imgs) {
+        bytes += img.total() * img.elemSize();
+    }
+    return bytes;
+}
+
 int LoopDetector::add_to_database(const FisheyeFrameDescriptor_t & new_fisheye_desc) {
+    auto msg_id = new_fisheye_desc.msg_id;
     for (size_t i = 0; i < new_fisheye_desc.images.size(); i++) {
         auto & img_desc = new_fisheye_desc.images[i];
         if (img_desc.landmark_num > 0) {
             int index = add_to_database(img_desc);
-            imgid2fisheye[index] = new_fisheye_desc.msg_id;
+            imgid2fisheye[index] = msg_id;
             imgid2dir[index] = i;
+            fisheye2imgids[msg_id].push_back(index);
             ROS_INFO("Add keyframe from %d(dir %d) to local keyframe database index: %d", img_desc.drone_id, i, index);
         }
     }
-    fisheyeframe_database[new_fisheye_desc.msg_id] = new_fisheye_desc;
-    return new_fisheye_desc.msg_id;
+    fisheyeframe_database[msg_id] = new_fisheye_desc;
+    drone2lastframe[new_fisheye_desc.drone_id] = msg_id;
+
+    auto it = msgid2cvimgs.find(msg_id);
+    size_t bytes = estimate_frame_bytes(new_fisheye_desc, it == msgid2cvimgs.end() ? std::vector<cv::Mat>() : it->second,
+        new_fisheye_desc.drone_id == self_id ? local_index.code_size() : remote_index.code_size());
+    fisheye2bytes[msg_id] = bytes;
+    database_bytes += bytes;
+    touch_frame(msg_id);
+
+    evict_over_budget();
+    return msg_id;
 }
 
-int LoopDetector::add_to_database(const ImageDescriptor_t & new_img_desc) {
-    if (new_img_desc.drone_id == self_id) {
-        local_index.add(1, new_img_desc.image_desc.data());
-        return local_index.ntotal - 1;
-    } else {
-        remote_index.add(1, new_img_desc.image_desc.data());
-        return remote_index.ntotal - 1 + REMOTE_MAGIN_NUMBER;
+bool LoopDetector::is_duplicate_frame(const FisheyeFrameDescriptor_t & new_fisheye_desc) {
+    auto it = drone2lastframe.find(new_fisheye_desc.drone_id);
+    if (LOOP_DB_DEDUP_DIS <= 0 || it == drone2lastframe.end()) {
+        return false;
     }
-    return -1;
+
+    auto & last_fisheye_desc = fisheyeframe_database.at(it->second);
+    auto dpose = Swarm::Pose::DeltaPose(Swarm::Pose(last_fisheye_desc.pose_drone), Swarm::Pose(new_fisheye_desc.pose_drone), false);
+    if (dpose.pos().norm() > LOOP_DB_DEDUP_DIS || fabs(dpose.yaw()) > LOOP_DB_DEDUP_YAW*DEG2RAD) {
+        return false;
+    }
+
+    //All directions available in both must look the same
+    int count = 0;
+    for (size_t i = 0; i < new_fisheye_desc.images.size() && i < last_fisheye_desc.images.size(); i++) {
+        auto & desc_new = new_fisheye_desc.images[i];
+        auto & desc_last = last_fisheye_desc.images[i];
+        if (desc_new.landmark_num == 0 || desc_last.landmark_num == 0 || desc_new.image_desc.size() != desc_last.image_desc.size()) {
+            continue;
+        }
+        double product = 0;
+        for (size_t j = 0; j < desc_new.image_desc.size(); j++) {
+            product += desc_new.image_desc[j] * desc_last.image_desc[j];
+        }
+        if (product < LOOP_DB_DEDUP_PRODUCT) {
+            return false;
+        }
+        count ++;
+    }
+    return count > 0;
 }
 
+void LoopDetector::touch_frame(int64_t msg_id) {
+    auto it = lru_pos.find(msg_id);
+    if (it != lru_pos.end()) {
+        lru_frames.splice(lru_frames.end(), lru_frames, it->second);
+    } else if (fisheyeframe_database.find(msg_id) != fisheyeframe_database.end()) {
+        lru_pos[msg_id] = lru_frames.insert(lru_frames.end(), msg_id);
+    }
+}
 
-int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, bool init_mode, bool nonkeyframe, double & distance) {
-    double thres = INNER_PRODUCT_THRES;
-    if (init_mode) {
-        thres = INIT_MODE_PRODUCT_THRES;
+void LoopDetector::evict_frame(int64_t msg_id) {
+    for (auto index : fisheye2imgids[msg_id]) {
+        if (index >= REMOTE_MAGIN_NUMBER) {
+            remote_index.remove(index - REMOTE_MAGIN_NUMBER);
+        } else {
+            local_index.remove(index);
+        }
+        imgid2fisheye.erase(index);
+        imgid2dir.erase(index);
     }
+    fisheye2imgids.erase(msg_id);
 
-    if (img_desc.drone_id == self_id) {
-        //Then this is self drone
-        int _id = query_from_database(img_desc, remote_index, true, thres, 1, distance);
-        if(!nonkeyframe){
-            int _id = query_from_database(img_desc, local_index, false, thres, MATCH_INDEX_DIST, distance);
-            return _id;
-        } else if (_id != -1) {
-            return _id;
-        } 
+    auto it = fisheyeframe_database.find(msg_id);
+    if (it != fisheyeframe_database.end()) {
+        auto last = drone2lastframe.find(it->second.drone_id);
+        if (last != drone2lastframe.end() && last->second == msg_id) {
+            drone2lastframe.erase(last);
+        }
+        fisheyeframe_database.erase(it);
+    }
+    msgid2cvimgs.erase(msg_id);
+
+    database_bytes -= fisheye2bytes[msg_id];
+    fisheye2bytes.erase(msg_id);
+
+    auto pos = lru_pos.find(msg_id);
+    if (pos != lru_pos.end()) {
+        lru_frames.erase(pos->second);
+        lru_pos.erase(pos);
+    }
+}
+
+void LoopDetector::evict_over_budget() {
+    if (LOOP_DB_MAX_MB <= 0) {
+        return;
+    }
+    size_t max_bytes = LOOP_DB_MAX_MB * 1024 * 1024;
+    int count = 0;
+    //Keep the newest frame anyway
+    while (database_bytes > max_bytes && lru_frames.size() > 1) {
+        evict_frame(lru_frames.front());
+        count ++;
+    }
+    if (count > 0) {
+        ROS_INFO("Loop database over budget %.0fMB, evict %d least recently used frames, %ld frames %.1fMB left", 
+            LOOP_DB_MAX_MB, count, fisheyeframe_database.size(), database_bytes / 1024.0 / 1024.0);
+    }
+}
+
+int LoopDetector::add_to_database(const ImageDescriptor_t & new_img_desc) {
+    if (OUTPUT_RAW_NETVLAD_DESC) {
+        fnetvlad.write((const char*)new_img_desc.image_desc.data(), GLOBAL_DESC_SIZE*sizeof(float));
+    }
+    if (new_img_desc.drone_id == self_id) {
+        return local_index.add(new_img_desc.image_desc.data());
     } else {
-        int _id = query_from_database(img_desc, local_index, false, thres, 1, distance);
-        // ROS_INFO("Is remote image, query only from remote db: %d", _id);
-        return _id;
+        return remote_index.add(new_img_desc.image_desc.data()) + REMOTE_MAGIN_NUMBER;
     }
     return -1;
 }
 
-int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & distance) {
-    float distances[1000] = {0};
-    faiss::Index::idx_t labels[1000];
 
+void LoopDetector::query_from_database(const FisheyeFrameDescriptor_t & new_fisheye_desc, const std::vector<int> & dirs, const LoopIndex & index, 
+        bool remote_db, double thres, int max_index, std::map<std::pair<int64_t, int>, LoopCandidate> & candidates) {
     int index_offset = 0;
     if (remote_db) {
         index_offset = REMOTE_MAGIN_NUMBER;
     }
-    
-    for (int i = 0; i < 1000; i++) {
-        labels[i] = -1;
-    }
 
+    int query_num = dirs.size();
     int search_num = SEARCH_NEAREST_NUM + max_index;
-    index.search(1, img_desc.image_desc.data(), search_num, distances, labels);
-    int return_msg_id = -1, return_drone_id = -1;
-    int k = -1;
-    for (int i = 0; i < search_num; i++) {
-        if (labels[i] < 0) {
-            continue;
-        }
+    //Distances of compressed index are approximate, re-rank more candidates by stored descriptors
+    int k = index.is_compressed() ? std::max(search_num, LOOP_INDEX_RERANK_NUM) : search_num;
 
-        if (imgid2fisheye.find(labels[i] + index_offset) == imgid2fisheye.end()) {
-            ROS_WARN("Can't find image %d; skipping", labels[i] + index_offset);
-            continue;
+    std::vector<float> queries(query_num * GLOBAL_DESC_SIZE);
+    for (int i = 0; i < query_num; i++) {
+        auto & image_desc = new_fisheye_desc.images[dirs[i]].image_desc;
+        std::copy(image_desc.begin(), image_desc.begin() + GLOBAL_DESC_SIZE, queries.begin() + i * GLOBAL_DESC_SIZE);
+    }
+
+    std::vector<float> distances(query_num * k);
+    std::vector<faiss::Index::idx_t> labels(query_num * k);
+    index.search(query_num, queries.data(), k, distances.data(), labels.data());
+
+    for (int i = 0; i < query_num; i++) {
+        float * _distances = distances.data() + i * k;
+        faiss::Index::idx_t * _labels = labels.data() + i * k;
+        if (index.is_compressed()) {
+            LoopIndex::rerank(queries.data() + i * GLOBAL_DESC_SIZE, GLOBAL_DESC_SIZE, k, _distances, _labels, search_num, 
+                [&](faiss::Index::idx_t label) -> const float* {
+                    auto it = imgid2fisheye.find(label + index_offset);
+                    if (it == imgid2fisheye.end()) {
+                        return nullptr;
+                    }
+                    return fisheyeframe_database[it->second].images[imgid2dir[label + index_offset]].image_desc.data();
+                });
         }
 
-        // int return_msg_id = imgid2fisheye.at(labels[i] + index_offset);
-        return_msg_id = labels[i] + index_offset;
-        return_drone_id = fisheyeframe_database[imgid2fisheye[return_msg_id]].drone_id;
+        for (int j = 0; j < search_num; j++) {
+            if (_labels[j] < 0) {
+                continue;
+            }
+
+            int image_id = _labels[j] + index_offset;
+            auto it = imgid2fisheye.find(image_id);
+            if (it == imgid2fisheye.end()) {
+                ROS_WARN("Can't find image %d; skipping", image_id);
+                continue;
+            }
 
-        //ROS_INFO("Return Label %d/%d/%d from %d, distance %f/%f", labels[i] + index_offset, index.ntotal, index.ntotal - max_index , return_drone_id, distances[i], thres);
-        
-        if (labels[i] <= index.ntotal - max_index && distances[i] > thres) {
-            //Is same id, max index make sense
-            k = i;
-            thres = distance = distances[i];
-            return return_msg_id;
+            //Max index skip recent images of same drone
+            if (_labels[j] > index.total_added() - max_index || _distances[j] <= thres) {
+                continue;
+            }
+
+            //Directions of a true loop are matched with same offset, which is the rotation between the frames
+            int dir_old = imgid2dir[image_id];
+            int offset = (dir_old - dirs[i] + MAX_DIRS) % MAX_DIRS;
+            auto & candidate = candidates[std::make_pair(it->second, offset)];
+            candidate.msg_id = it->second;
+            candidate.votes ++;
+            candidate.score += _distances[j];
+            if (_distances[j] > candidate.best_distance) {
+                candidate.best_distance = _distances[j];
+                candidate.dir_new = dirs[i];
+                candidate.dir_old = dir_old;
+            }
         }
     }
-
-    // ROS_INFO("Database return %ld on drone %d, radius %f msg_id %d", labels[k] + index_offset, return_drone_id, distances[k], return_msg_id);
-    return return_msg_id;
 }
 
 
 FisheyeFrameDescriptor_t & LoopDetector::query_fisheyeframe_from_database(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int & direction_new, int & direction_old) {
-    double best_distance = -1;
-    int best_image_id = -1;
-    //Strict use direction 1 now
-    direction_new = 0;
-    if (loop_cam->get_camera_configuration() == CameraConfig::STEREO_FISHEYE) {
-        direction_new = 1;
-    } else if (
-        loop_cam->get_camera_configuration() == CameraConfig::STEREO_PINHOLE ||
-        loop_cam->get_camera_configuration() == CameraConfig::PINHOLE_DEPTH
-    ) {
-        direction_new = 0;
-    } else {
+    auto camera_configuration = loop_cam->get_camera_configuration();
+    if (camera_configuration != CameraConfig::STEREO_FISHEYE && camera_configuration != CameraConfig::STEREO_PINHOLE &&
+        camera_configuration != CameraConfig::PINHOLE_DEPTH) {
         ROS_ERROR("Camera configuration %d not support yet in query_fisheyeframe_from_database", loop_cam->get_camera_configuration());
         exit(-1);
     }
 
-    if (new_img_desc.images[direction_new].landmark_num > 0) {
-        double distance = -1;
-        int id = query_from_database(new_img_desc.images.at(direction_new), init_mode, nonkeyframe, distance);
-        if (id != -1 && distance > best_distance) {
-            best_image_id = id;
+    //All available directions are queried in one batch
+    std::vector<int> dirs;
+    for (size_t i = 0; i < new_img_desc.images.size(); i++) {
+        if (new_img_desc.images[i].landmark_num > 0) {
+            dirs.push_back(i);
         }
+    }
 
-        // ROS_INFO("query_from_database(new_img_desc.images.at(direction_new) return %d best_image_id %d distance %f/%f", 
-            // id, best_image_id, distance, best_distance);
+    double thres = INNER_PRODUCT_THRES;
+    if (init_mode) {
+        thres = INIT_MODE_PRODUCT_THRES;
+    }
 
+    std::map<std::pair<int64_t, int>, LoopCandidate> candidates;
+    if (!dirs.empty()) {
+        if (new_img_desc.drone_id == self_id) {
+            //Keyframe of self drone looks for loops in local database, nonkeyframe only for remote drones
+            if (!nonkeyframe) {
+                query_from_database(new_img_desc, dirs, local_index, false, thres, MATCH_INDEX_DIST, candidates);
+            } else {
+                query_from_database(new_img_desc, dirs, remote_index, true, thres, 1, candidates);
+            }
+        } else {
+            query_from_database(new_img_desc, dirs, local_index, false, thres, 1, candidates);
+        }
+    }
 
-        if (best_image_id != -1) {
-            int msg_id = imgid2fisheye[best_image_id];
-            direction_old = imgid2dir[best_image_id];
-            FisheyeFrameDescriptor_t & ret = fisheyeframe_database[msg_id];
-            ROS_INFO("Database return image %d fisheye frame from drone %d with direction %d dist %f", 
-                best_image_id, ret.drone_id, direction_old, distance);
-            return ret;
+    //Candidate voted by most directions wins, then by sum of inner products
+    const LoopCandidate * best = nullptr;
+    for (auto & it : candidates) {
+        auto & candidate = it.second;
+        if (best == nullptr || candidate.votes > best->votes || 
+            (candidate.votes == best->votes && candidate.score > best->score)) {
+            best = &candidate;
         }
     }
 
+    if (best != nullptr) {
+        direction_new = best->dir_new;
+        direction_old = best->dir_old;
+        FisheyeFrameDescriptor_t & ret = fisheyeframe_database[best->msg_id];
+        ROS_INFO("Database return fisheye frame %ld from drone %d with direction %d->%d votes %d/%ld dist %f", 
+            best->msg_id, ret.drone_id, direction_new, direction_old, best->votes, dirs.size(), best->best_distance);
+        touch_frame(best->msg_id);
+        return ret;
+    }
+
     direction_old = -1;
     FisheyeFrameDescriptor_t ret;
     ret.msg_id = -1;
     return ret;
 }
 
-
 int LoopDetector::database_size() const {
-    return local_index.ntotal + remote_index.ntotal;
+    return local_index.size() + remote_index.size();
 }
 
 bool pnp_result_verify(bool pnp_success, bool init_mode, int inliers, double rperr, const Swarm::Pose & DP_old_to_new) {
@@ -529,26 +689,36 @@ bool LoopDetector::compute_correspond_features(const FisheyeFrameDescriptor_t &
 
     int matched_dir_count = 0;
 
-    for (size_t i = 0; i < dirs_new.size(); i++) {
-        int dir_new = dirs_new[i];
-        int dir_old = dirs_old[i];
-        std::vector<cv::Point2f> _new_norm_2d;
-        std::vector<cv::Point3f> _new_3d;
-        std::vector<int> _new_idx;
-        std::vector<cv::Point2f> _old_norm_2d;
-        std::vector<cv::Point3f> _old_3d;
-        std::vector<int> _old_idx;
-
+    //Matching of direction pairs is independent, each pair uses its own matcher
+    int pair_num = dirs_new.size();
+    std::vector<std::vector<cv::Point2f>> new_norm_2d_dirs(pair_num), old_norm_2d_dirs(pair_num);
+    std::vector<std::vector<cv::Point3f>> new_3d_dirs(pair_num), old_3d_dirs(pair_num);
+    std::vector<std::vector<int>> new_idx_dirs(pair_num), old_idx_dirs(pair_num);
+    auto match_dir = [&](int i) {
         compute_correspond_features(
-            new_frame_desc.images[dir_new],
-            old_frame_desc.images[dir_old],
-            _new_norm_2d,
-            _new_3d,
-            _new_idx,
-            _old_norm_2d,
-            _old_3d,
-            _old_idx
+            new_frame_desc.images[dirs_new[i]],
+            old_frame_desc.images[dirs_old[i]],
+            new_norm_2d_dirs[i],
+            new_3d_dirs[i],
+            new_idx_dirs[i],
+            old_norm_2d_dirs[i],
+            old_3d_dirs[i],
+            old_idx_dirs[i],
+            matchers[i]
         );
+    };
+
+    dir_pool.parallel_for(pair_num, match_dir);
+
+    for (int i = 0; i < pair_num; i++) {
+        int dir_new = dirs_new[i];
+        int dir_old = dirs_old[i];
+        auto & _new_norm_2d = new_norm_2d_dirs[i];
+        auto & _new_3d = new_3d_dirs[i];
+        auto & _new_idx = new_idx_dirs[i];
+        auto & _old_norm_2d = old_norm_2d_dirs[i];
+        auto & _old_3d = old_3d_dirs[i];
+        auto & _old_idx = old_idx_dirs[i];
 
         ROS_INFO("compute_correspond_features on direction %d:%d gives %d common features", dir_old, dir_new, _new_3d.size());
 
@@ -594,7 +764,8 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
         std::vector<int> &new_idx,
         std::vector<cv::Point2f> &old_norm_2d,
         std::vector<cv::Point3f> &old_3d,
-        std::vector<int> &old_idx) {
+        std::vector<int> &old_idx,
+        FeatureMatcher & matcher) {
 
     assert(new_img_desc.landmarks_2d.size() * FEATURE_DESC_SIZE == new_img_desc.feature_descriptor.size() && "Desciptor size of new img desc must equal to to landmarks*256!!!");
     assert(old_img_desc.landmarks_2d.size() * FEATURE_DESC_SIZE == old_img_desc.feature_descriptor.size() && "Desciptor size of old img desc must equal to to landmarks*256!!!");
@@ -607,16 +778,9 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
     auto _now_2d = toCV(new_img_desc.landmarks_2d);
     auto _now_3d = toCV(new_img_desc.landmarks_3d);
 
-    cv::Mat desc_now( _now_norm_2d.size(), FEATURE_DESC_SIZE, CV_32F);
-    memcpy(desc_now.data, new_img_desc.feature_descriptor.data(), new_img_desc.feature_descriptor.size()*sizeof(float));
-
-    cv::Mat desc_old( old_img_desc.landmarks_2d.size(), FEATURE_DESC_SIZE, CV_32F);
-    memcpy(desc_old.data, old_img_desc.feature_descriptor.data(), old_img_desc.feature_descriptor.size()*sizeof(float));
-    
-    cv::BFMatcher bfmatcher(cv::NORM_L2, true);
     std::vector<cv::DMatch> _matches;
     std::vector<unsigned char> mask;
-    bfmatcher.match(desc_now, desc_old, _matches);
+    matcher.match(new_img_desc.feature_descriptor, old_img_desc.feature_descriptor, _matches);
 
 #ifdef USE_FUNDMENTAL
     std::vector<cv::Point2f> old_2d, new_2d;
@@ -845,7 +1009,16 @@ void LoopDetector::on_loop_connection(LoopConnection & loop_conn) {
     on_loop_cb(loop_conn);
 }
 
-LoopDetector::LoopDetector(): local_index(DEEP_DESC_SIZE), remote_index(DEEP_DESC_SIZE) {
+LoopDetector::LoopDetector():
+    matchers(MAX_DIRS, FeatureMatcher(FEATURE_MATCH_INT8, FEATURE_MATCH_RATIO)),
+    dir_pool(DIR_WORKER_NUM),
+    local_index(LOOP_INDEX_TYPE, GLOBAL_DESC_SIZE, LOOP_INDEX_NLIST, LOOP_INDEX_TRAIN_SIZE, LOOP_INDEX_NPROBE, LOOP_INDEX_HNSW_M, LOOP_INDEX_PQ_M),
+    remote_index(LOOP_INDEX_TYPE, GLOBAL_DESC_SIZE, LOOP_INDEX_NLIST, LOOP_INDEX_TRAIN_SIZE, LOOP_INDEX_NPROBE, LOOP_INDEX_HNSW_M, LOOP_INDEX_PQ_M) {
+    if (OUTPUT_RAW_NETVLAD_DESC) {
+        //Raw float32 of GLOBAL_DESC_SIZE per descriptor, for loop_index_benchmark
+        fnetvlad.open(OUTPUT_PATH+"netvlad.bin", std::fstream::out | std::fstream::app | std::fstream::binary);
+    }
+
     cv::RNG rng;
     for(int i = 0; i < 100; i++)
     {
@@ -0,0 +1,204 @@
+#include "loop_index.h"
+#include <algorithm>
+
+//HNSW graph is rebuilt when removed entries are more than this part of it
+#define HNSW_REBUILD_RATIO 0.5
+
+LoopIndex::LoopIndex(const std::string & _type, int _dim, int _nlist, int _train_size, int _nprobe, int _hnsw_m, int _pq_m):
+    type(_type), dim(_dim), nlist(_nlist), train_size(std::max(_train_size, _nlist)), nprobe(_nprobe), hnsw_m(_hnsw_m), pq_m(_pq_m) {
+    if (type == "hnsw") {
+        create_hnsw();
+    } else {
+        if (type != "flat" && type != "ivf" && type != "ivfsq8" && type != "ivfpq") {
+            ROS_WARN("Unknown loop index type %s, use flat", type.c_str());
+            type = "flat";
+        }
+        if (type == "ivfpq" && dim % pq_m != 0) {
+            ROS_WARN("Descriptor dim %d is not divisible by %d sub quantizers, use ivfsq8", dim, pq_m);
+            type = "ivfsq8";
+        }
+        flat_storage = new faiss::IndexFlatIP(dim);
+        flat_index = new faiss::IndexIDMap2(flat_storage);
+        if (type != "flat") {
+            ivf_quantizer = new faiss::IndexFlatIP(dim);
+        }
+        if (type == "ivf") {
+            ivf_index = new faiss::IndexIVFFlat(ivf_quantizer, dim, nlist, faiss::METRIC_INNER_PRODUCT);
+        } else if (type == "ivfsq8") {
+            ivf_index = new faiss::IndexIVFScalarQuantizer(ivf_quantizer, dim, nlist, faiss::ScalarQuantizer::QT_8bit,
+                faiss::METRIC_INNER_PRODUCT);
+        } else if (type == "ivfpq") {
+            //8 bits per sub quantizer, so pq_m bytes per descriptor
+            ivf_index = new faiss::IndexIVFPQ(ivf_quantizer, dim, nlist, pq_m, 8, faiss::METRIC_INNER_PRODUCT);
+        }
+        if (ivf_index != nullptr) {
+            ivf_index->nprobe = nprobe;
+        }
+    }
+    ROS_INFO("Loop index type %s dim %d", type.c_str(), dim);
+}
+
+LoopIndex::~LoopIndex() {
+    delete flat_index;
+    delete flat_storage;
+    delete ivf_index;
+    delete ivf_quantizer;
+    delete hnsw_index;
+    delete hnsw_storage;
+}
+
+void LoopIndex::create_hnsw() {
+    hnsw_storage = new faiss::IndexHNSWFlat(dim, hnsw_m, faiss::METRIC_INNER_PRODUCT);
+    hnsw_index = new faiss::IndexIDMap(hnsw_storage);
+}
+
+faiss::Index::idx_t LoopIndex::add(const float * desc) {
+    faiss::Index::idx_t id = added_num;
+    added_num ++;
+    if (hnsw_index != nullptr) {
+        hnsw_index->add_with_ids(1, desc, &id);
+    } else if (ivf_index != nullptr && ivf_index->is_trained) {
+        ivf_index->add_with_ids(1, desc, &id);
+    } else {
+        flat_index->add_with_ids(1, desc, &id);
+        if (ivf_index != nullptr && flat_index->ntotal >= train_size) {
+            train_ivf();
+        }
+    }
+    return id;
+}
+
+void LoopIndex::train_ivf() {
+    auto start = ros::WallTime::now();
+    int num = flat_index->ntotal;
+    std::vector<float> descs(num * dim);
+    for (int i = 0; i < num; i++) {
+        flat_storage->reconstruct(i, descs.data() + i * dim);
+    }
+    ivf_index->train(num, descs.data());
+    ivf_index->add_with_ids(num, descs.data(), flat_index->id_map.data());
+    flat_index->reset();
+    ROS_INFO("Loop index: IVF with %d lists trained on %d descriptors, cost %.1fms", nlist, num,
+        (ros::WallTime::now() - start).toSec() * 1000);
+}
+
+void LoopIndex::rebuild_hnsw() {
+    auto start = ros::WallTime::now();
+    auto old_storage = hnsw_storage;
+    auto old_index = hnsw_index;
+    create_hnsw();
+
+    std::vector<float> descs;
+    std::vector<faiss::Index::idx_t> ids;
+    for (int i = 0; i < old_index->ntotal; i++) {
+        auto id = old_index->id_map[i];
+        if (hnsw_removed.find(id) == hnsw_removed.end()) {
+            descs.resize(descs.size() + dim);
+            old_storage->reconstruct(i, descs.data() + descs.size() - dim);
+            ids.push_back(id);
+        }
+    }
+    if (!ids.empty()) {
+        hnsw_index->add_with_ids(ids.size(), descs.data(), ids.data());
+    }
+    hnsw_removed.clear();
+    delete old_index;
+    delete old_storage;
+    ROS_INFO("Loop index: HNSW rebuilt with %ld descriptors, cost %.1fms", ids.size(),
+        (ros::WallTime::now() - start).toSec() * 1000);
+}
+
+void LoopIndex::remove(faiss::Index::idx_t id) {
+    if (hnsw_index != nullptr) {
+        hnsw_removed.insert(id);
+        if (hnsw_removed.size() > HNSW_REBUILD_RATIO * hnsw_index->ntotal) {
+            rebuild_hnsw();
+        }
+        return;
+    }
+
+    faiss::IDSelectorRange sel(id, id + 1);
+    if (ivf_index != nullptr && ivf_index->is_trained) {
+        ivf_index->remove_ids(sel);
+    } else {
+        flat_index->remove_ids(sel);
+    }
+}
+
+void LoopIndex::search(int n, const float * descs, int k, float * distances, faiss::Index::idx_t * labels) const {
+    std::fill(labels, labels + n * k, -1);
+    if (size() == 0) {
+        return;
+    }
+
+    if (hnsw_index == nullptr) {
+        if (ivf_index != nullptr && ivf_index->is_trained) {
+            ivf_index->search(n, descs, k, distances, labels);
+        } else {
+            flat_index->search(n, descs, k, distances, labels);
+        }
+        return;
+    }
+
+    if (hnsw_removed.empty()) {
+        hnsw_index->search(n, descs, k, distances, labels);
+        return;
+    }
+
+    //Search more and drop removed ones
+    int _k = std::min((int)hnsw_index->ntotal, k + (int)hnsw_removed.size());
+    std::vector<float> _distances(n * _k);
+    std::vector<faiss::Index::idx_t> _labels(n * _k);
+    hnsw_index->search(n, descs, _k, _distances.data(), _labels.data());
+    for (int i = 0; i < n; i++) {
+        int count = 0;
+        for (int j = 0; j < _k && count < k; j++) {
+            auto label = _labels[i * _k + j];
+            if (label >= 0 && hnsw_removed.find(label) == hnsw_removed.end()) {
+                labels[i * k + count] = label;
+                distances[i * k + count] = _distances[i * _k + j];
+                count ++;
+            }
+        }
+    }
+}
+
+int LoopIndex::size() const {
+    if (hnsw_index != nullptr) {
+        return hnsw_index->ntotal - hnsw_removed.size();
+    }
+    if (ivf_index != nullptr && ivf_index->is_trained) {
+        return ivf_index->ntotal;
+    }
+    return flat_index->ntotal;
+}
+
+void LoopIndex::rerank(const float * query, int dim, int k_in, float * distances, faiss::Index::idx_t * labels, int k_out,
+    std::function<const float*(faiss::Index::idx_t)> get_desc) {
+    std::vector<std::pair<float, faiss::Index::idx_t>> candidates;
+    for (int i = 0; i < k_in; i++) {
+        if (labels[i] < 0) {
+            continue;
+        }
+        const float * desc = get_desc(labels[i]);
+        if (desc == nullptr) {
+            continue;
+        }
+        float ip = 0;
+        for (int j = 0; j < dim; j++) {
+            ip += query[j] * desc[j];
+        }
+        candidates.emplace_back(ip, labels[i]);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, faiss::Index::idx_t> & a, const std::pair<float, faiss::Index::idx_t> & b) {
+        return a.first > b.first;
+    });
+    for (int i = 0; i < k_out; i++) {
+        if (i < (int)candidates.size()) {
+            distances[i] = candidates[i].first;
+            labels[i] = candidates[i].second;
+        } else {
+            labels[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include "ros/ros.h"
+#include <fstream>
+#include <set>
+#include <chrono>
+#include "loop_defines.h"
+#include "loop_index.h"
+
+using namespace std::chrono;
+
+//Compare approximate loop indexes with flat index on recorded global descriptors (output_raw_netvlad_desc of swarm_loop).
+//Last query_num descriptors are queries and the rest is the database, ground truth is top k of flat search.
+std::vector<float> read_descriptors(const std::string & path, int dim) {
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    std::vector<float> descs;
+    if (!fin.good()) {
+        ROS_ERROR("Unable to open descriptors %s", path.c_str());
+        return descs;
+    }
+    size_t size = fin.tellg();
+    descs.resize(size / sizeof(float) / dim * dim);
+    fin.seekg(0);
+    fin.read((char*) descs.data(), descs.size() * sizeof(float));
+    return descs;
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "loop_index_benchmark");
+    ros::NodeHandle nh("~");
+
+    std::string desc_path;
+    std::vector<std::string> index_types;
+    int query_num, k;
+    nh.param<std::string>("desc_path", desc_path, "netvlad.bin");
+    nh.param<std::vector<std::string>>("index_types", index_types, {"flat", "ivf", "ivfsq8", "ivfpq", "hnsw"});
+    nh.param<int>("query_num", query_num, 200);
+    nh.param<int>("k", k, SEARCH_NEAREST_NUM);
+    nh.param<int>("nlist", LOOP_INDEX_NLIST, 32);
+    nh.param<int>("train_size", LOOP_INDEX_TRAIN_SIZE, 1000);
+    nh.param<int>("nprobe", LOOP_INDEX_NPROBE, 4);
+    nh.param<int>("hnsw_m", LOOP_INDEX_HNSW_M, 32);
+    nh.param<int>("pq_m", LOOP_INDEX_PQ_M, 16);
+    nh.param<int>("rerank_num", LOOP_INDEX_RERANK_NUM, 20);
+    //Size of recorded descriptors, e.g. PCA dim when recorded with netvlad PCA
+    nh.param<int>("desc_size", GLOBAL_DESC_SIZE, DEEP_DESC_SIZE);
+
+    auto descs = read_descriptors(desc_path, GLOBAL_DESC_SIZE);
+    int total = descs.size() / GLOBAL_DESC_SIZE;
+    query_num = std::min(query_num, total / 2);
+    int db_num = total - query_num;
+    if (query_num <= 0) {
+        ROS_ERROR("Too few descriptors %d in %s", total, desc_path.c_str());
+        return -1;
+    }
+    const float * queries = descs.data() + db_num * GLOBAL_DESC_SIZE;
+    ROS_INFO("Loop index benchmark: %d database descriptors %d queries k %d", db_num, query_num, k);
+
+    std::vector<float> gt_distances(query_num * k);
+    std::vector<faiss::Index::idx_t> gt_labels(query_num * k);
+    {
+        LoopIndex flat("flat", GLOBAL_DESC_SIZE);
+        for (int i = 0; i < db_num; i++) {
+            flat.add(descs.data() + i * GLOBAL_DESC_SIZE);
+        }
+        flat.search(query_num, queries, k, gt_distances.data(), gt_labels.data());
+    }
+
+    printf("TYPE     ADD_MS  QUERY_MS  BATCH_QUERY_MS  RECALL@%d  TOP1  BYTES_PER_DESC\n", k);
+    for (auto & type : index_types) {
+        LoopIndex index(type, GLOBAL_DESC_SIZE, LOOP_INDEX_NLIST, LOOP_INDEX_TRAIN_SIZE, LOOP_INDEX_NPROBE, LOOP_INDEX_HNSW_M, LOOP_INDEX_PQ_M);
+        auto t1 = high_resolution_clock::now();
+        for (int i = 0; i < db_num; i++) {
+            index.add(descs.data() + i * GLOBAL_DESC_SIZE);
+        }
+        double add_ms = duration_cast<microseconds>(high_resolution_clock::now() - t1).count() / 1000.0;
+
+        //Compressed index is searched for more candidates and re-ranked by full precision descriptors, as in LoopDetector
+        int search_k = index.is_compressed() ? std::max(k, LOOP_INDEX_RERANK_NUM) : k;
+        auto get_desc = [&](faiss::Index::idx_t label) -> const float* {
+            return label < db_num ? descs.data() + label * GLOBAL_DESC_SIZE : nullptr;
+        };
+
+        //One by one as in LoopDetector
+        std::vector<float> distances(query_num * search_k);
+        std::vector<faiss::Index::idx_t> labels(query_num * search_k);
+        t1 = high_resolution_clock::now();
+        for (int i = 0; i < query_num; i++) {
+            index.search(1, queries + i * GLOBAL_DESC_SIZE, search_k, distances.data() + i * search_k, labels.data() + i * search_k);
+            if (index.is_compressed()) {
+                LoopIndex::rerank(queries + i * GLOBAL_DESC_SIZE, GLOBAL_DESC_SIZE, search_k, distances.data() + i * search_k, 
+                    labels.data() + i * search_k, k, get_desc);
+            }
+        }
+        double query_ms = duration_cast<microseconds>(high_resolution_clock::now() - t1).count() / 1000.0 / query_num;
+
+        std::vector<float> batch_distances(query_num * search_k);
+        std::vector<faiss::Index::idx_t> batch_labels(query_num * search_k);
+        t1 = high_resolution_clock::now();
+        index.search(query_num, queries, search_k, batch_distances.data(), batch_labels.data());
+        double batch_query_ms = duration_cast<microseconds>(high_resolution_clock::now() - t1).count() / 1000.0 / query_num;
+
+        int hit = 0, top1 = 0;
+        for (int i = 0; i < query_num; i++) {
+            std::set<faiss::Index::idx_t> gt(gt_labels.begin() + i * k, gt_labels.begin() + (i + 1) * k);
+            for (int j = 0; j < k; j++) {
+                auto label = labels[i * search_k + j];
+                if (label >= 0 && gt.find(label) != gt.end()) {
+                    hit ++;
+                }
+            }
+            if (labels[i * search_k] == gt_labels[i * k]) {
+                top1 ++;
+            }
+        }
+        printf("%-8s %7.1f %9.3f %15.3f %9.3f %5.3f %15d\n", type.c_str(), add_ms, query_ms, batch_query_ms,
+            (double) hit / (query_num * k), (double) top1 / query_num, index.code_size());
+        fflush(stdout);
+    }
+    return 0;
+}
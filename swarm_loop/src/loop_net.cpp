@@ -27,7 +27,7 @@ void LoopNet::broadcast_fisheye_desc(FisheyeFrameDescriptor_t & fisheye_desc) {
 void LoopNet::broadcast_img_desc(ImageDescriptor_t & img_des) {
     int64_t msg_id = rand() + img_des.timestamp.nsec;
     img_des.msg_id = msg_id;
-    sent_message.insert(img_des.msg_id);
+    add_sent_message(img_des.msg_id);
 
     int byte_sent = 0;
     if (IS_PC_REPLAY) {
@@ -74,7 +74,7 @@ void LoopNet::broadcast_img_desc(ImageDescriptor_t & img_des) {
             lm.feature_descriptor = std::vector<float>(img_des.feature_descriptor.data() + i *FEATURE_DESC_SIZE, 
                 img_des.feature_descriptor.data() + (i+1)*FEATURE_DESC_SIZE);
             int64_t msg_id = rand() + img_des.timestamp.nsec;
-            sent_message.insert(img_des.msg_id);
+            add_sent_message(img_des.msg_id);
 
             lm.msg_id = msg_id;
             lm.header_id = img_des.msg_id;
@@ -112,7 +112,7 @@ void LoopNet::broadcast_loop_connection(LoopConnection & loop_conn) {
     auto _loop_conn = toLCMLoopConnection(loop_conn);
     _loop_conn.msg_id = rand() + loop_conn.ts_a.nsec;
 
-    sent_message.insert(_loop_conn.msg_id);
+    add_sent_message(_loop_conn.msg_id);
     lcm.publish("SWARM_LOOP_CONN", &_loop_conn);
 }
 
@@ -120,7 +120,7 @@ void LoopNet::on_img_desc_recevied(const lcm::ReceiveBuffer* rbuf,
                 const std::string& chan, 
                 const ImageDescriptor_t* msg) {
     
-    if (sent_message.find(msg->msg_id) != sent_message.end()) {
+    if (is_sent_message(msg->msg_id)) {
         // ROS_INFO("Receive self sent IMG message");
         return;
     }
@@ -164,7 +164,7 @@ void LoopNet::on_loop_connection_recevied(const lcm::ReceiveBuffer* rbuf,
                 const std::string& chan, 
                 const LoopConnection_t* msg) {
 
-    if (sent_message.find(msg->msg_id) != sent_message.end()) {
+    if (is_sent_message(msg->msg_id)) {
         // ROS_INFO("Receive self sent Loop message");
         return;
     }
@@ -239,6 +239,10 @@ void LoopNet::scan_recv_packets() {
             this->image_desc_callback(msg);
         }
         received_images.erase(_id);
+        recv_lock.lock();
+        msg_header_recv_time.erase(_id);
+        msg_recv_last_time.erase(_id);
+        recv_lock.unlock();
     }
 
     std::vector<int64_t> finish_recv_frames;
@@ -269,6 +273,7 @@ void LoopNet::scan_recv_packets() {
 
         frame_desc_callback(frame_desc);
         received_frames.erase(frame_hash);
+        frame_header_recv_time.erase(frame_hash);
     }
 }
 
@@ -18,5 +18,24 @@ bool SEND_ALL_FEATURES;
 bool LOWER_CAM_AS_MAIN;
 int MAX_DIRS;
 bool OUTPUT_RAW_SUPERPOINT_DESC;
+bool SUPERPOINT_PER_CHANNEL_NORM = true;
+bool OUTPUT_RAW_NETVLAD_DESC;
+std::string LOOP_INDEX_TYPE = "flat";
+int LOOP_INDEX_NLIST = 32;
+int LOOP_INDEX_TRAIN_SIZE = 1000;
+int LOOP_INDEX_NPROBE = 4;
+int LOOP_INDEX_HNSW_M = 32;
+int LOOP_INDEX_PQ_M = 16;
+int LOOP_INDEX_RERANK_NUM = 20;
+double LOOP_DB_MAX_MB = 0;
+double LOOP_DB_DEDUP_DIS = 0.2;
+double LOOP_DB_DEDUP_YAW = 10;
+double LOOP_DB_DEDUP_PRODUCT = 0.95;
+bool FEATURE_MATCH_INT8 = false;
+double FEATURE_MATCH_RATIO = 1.0;
+int DIR_WORKER_NUM = 0;
+std::string LOOP_CNN_BACKEND = "tensorrt";
+int LOOP_CNN_THREADS = 1;
+int GLOBAL_DESC_SIZE = DEEP_DESC_SIZE;
 double DEPTH_NEAR_THRES;
 double DEPTH_FAR_THRES;
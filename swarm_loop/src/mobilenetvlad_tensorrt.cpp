@@ -8,7 +8,14 @@ std::vector<float> MobileNetVLADTensorRT::inference(const cv::Mat & input) {
     } else {
         input.convertTo(_input, CV_32F);
     }
-    doInference(_input);
+    backend->doInference(_input);
 
-    return std::vector<float>(m_OutputTensors[0].hostBuffer, m_OutputTensors[0].hostBuffer+descriptor_size);
+    if (use_pca) {
+        Eigen::Map<Eigen::RowVectorXf> desc(backend->output(0), descriptor_size);
+        Eigen::RowVectorXf desc_new = (desc.head(pca_mean.size()) - pca_mean) * pca_comp_T;
+        desc_new.normalize();
+        return std::vector<float>(desc_new.data(), desc_new.data() + desc_new.size());
+    }
+
+    return std::vector<float>(backend->output(0), backend->output(0)+descriptor_size);
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include "superpoint_tensorrt.h"
+
+//Compare sample_superpoint_descriptors with a double precision reference of the former libtorch code:
+//grid_sampler(desc, grid, 0, 0, 0) on 1 x SP_DESC_RAW_LEN x H/8 x W/8 with grid of 2 * pt / size - 1,
+//then torch::norm(desc, 2, 1) on SP_DESC_RAW_LEN x N (per channel) or the SuperPoint normalization per keypoint.
+void reference_descriptors(const std::vector<float> & desc_map, int width, int height, const std::vector<cv::Point2f> & kpts,
+    bool per_channel_norm, std::vector<double> & desc) {
+    int desc_w = width / 8, desc_h = height / 8;
+    int num = kpts.size();
+    desc.assign(num * SP_DESC_RAW_LEN, 0);
+    auto at = [&](int c, int y, int x) -> double {
+        if (x < 0 || x >= desc_w || y < 0 || y >= desc_h) {
+            return 0;
+        }
+        return desc_map[(c * desc_h + y) * desc_w + x];
+    };
+    for (int i = 0; i < num; i++) {
+        double gx = 2.0 * kpts[i].x / width - 1;
+        double gy = 2.0 * kpts[i].y / height - 1;
+        //Unnormalize with align_corners false
+        double ix = ((gx + 1) * desc_w - 1) / 2;
+        double iy = ((gy + 1) * desc_h - 1) / 2;
+        int x0 = std::floor(ix), y0 = std::floor(iy);
+        double ax = ix - x0, ay = iy - y0;
+        for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+            desc[i * SP_DESC_RAW_LEN + c] = (1 - ax) * (1 - ay) * at(c, y0, x0) + ax * (1 - ay) * at(c, y0, x0 + 1) +
+                (1 - ax) * ay * at(c, y0 + 1, x0) + ax * ay * at(c, y0 + 1, x0 + 1);
+        }
+    }
+
+    if (per_channel_norm) {
+        for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+            double sqr = 0;
+            for (int i = 0; i < num; i++) {
+                sqr += desc[i * SP_DESC_RAW_LEN + c] * desc[i * SP_DESC_RAW_LEN + c];
+            }
+            for (int i = 0; i < num; i++) {
+                desc[i * SP_DESC_RAW_LEN + c] /= std::sqrt(sqr);
+            }
+        }
+    } else {
+        for (int i = 0; i < num; i++) {
+            double sqr = 0;
+            for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                sqr += desc[i * SP_DESC_RAW_LEN + c] * desc[i * SP_DESC_RAW_LEN + c];
+            }
+            for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                desc[i * SP_DESC_RAW_LEN + c] /= std::sqrt(sqr);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const int width = 400, height = 208, num = 200, trials = 10;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> value(0, 1);
+    std::uniform_int_distribution<int> px(0, width - 1), py(0, height - 1);
+
+    std::vector<float> desc_map(SP_DESC_RAW_LEN * (width / 8) * (height / 8));
+    std::vector<cv::Point2f> kpts(num);
+    std::vector<float> desc;
+    std::vector<double> ref;
+    int failed = 0;
+    for (bool per_channel_norm : {true, false}) {
+        double max_err = 0;
+        for (int t = 0; t < trials; t++) {
+            for (auto & v : desc_map) {
+                v = value(rng);
+            }
+            //Keypoints are integer pixels from NMS, including the borders
+            for (int i = 0; i < num; i++) {
+                kpts[i] = cv::Point2f(px(rng), py(rng));
+            }
+            kpts[0] = cv::Point2f(0, 0);
+            kpts[1] = cv::Point2f(width - 1, height - 1);
+
+            sample_superpoint_descriptors(desc_map.data(), width, height, kpts, per_channel_norm, desc);
+            reference_descriptors(desc_map, width, height, kpts, per_channel_norm, ref);
+            for (size_t i = 0; i < desc.size(); i++) {
+                max_err = std::max(max_err, std::fabs(desc[i] - ref[i]));
+            }
+        }
+        printf("%-12s max error %.2e\n", per_channel_norm ? "per channel" : "per keypoint", max_err);
+        if (!(max_err < 1e-5)) {
+            failed ++;
+        }
+    }
+    if (failed > 0) {
+        printf("SuperPoint descriptor sampling differs from reference\n");
+        return 1;
+    }
+    return 0;
+}
@@ -1,16 +1,26 @@
 #include "superpoint_tensorrt.h"
 #include "loop_defines.h"
-#include "ATen/Parallel.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUPERPOINT_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SUPERPOINT_NEON
+#endif
 
 #define USE_PCA
-//NMS code is modified from https://github.com/KinglittleQ/SuperPoint_SLAM
-void NMS2(std::vector<cv::Point2f> det, cv::Mat conf, std::vector<cv::Point2f>& pts,
-            int border, int dist_thresh, int img_width, int img_height, int max_num);
+//Keypoints closer than NMS_DIST pixels (in both x and y) to a stronger one are suppressed
+#define NMS_DIST 4
 
 #define MAXBUFSIZE 100000
 Eigen::MatrixXf load_csv_mat_eigen(std::string csv) {
     int cols = 0, rows = 0;
-    double buff[MAXBUFSIZE];
+    //PCA of global descriptor is larger than MAXBUFSIZE
+    std::vector<double> buff;
 
     // Read numbers from file into buffer.
     std::ifstream infile;
@@ -25,7 +35,7 @@ Eigen::MatrixXf load_csv_mat_eigen(std::string csv) {
 
         while (std::getline(lineStream, cell, ','))
         {
-            buff[rows * cols + temp_cols] = std::stod(cell);
+            buff.push_back(std::stod(cell));
             temp_cols ++;
         }
 
@@ -90,22 +100,24 @@ SuperPointTensorRT::SuperPointTensorRT(std::string engine_path,
     std::string _pca_mean,
     int _width, int _height, 
     float _thres, int _max_num, 
-    bool _enable_perf):
-    TensorRTInferenceGeneric("image", _width, _height), thres(_thres), max_num(_max_num), enable_perf(_enable_perf) {
-    at::set_num_threads(1);
-    TensorInfo outputTensorSemi, outputTensorDesc;
-    outputTensorSemi.blobName = "semi";
-    outputTensorDesc.blobName = "desc";
-    outputTensorSemi.volume = height*width;
-    outputTensorDesc.volume = 1*SP_DESC_RAW_LEN*height/8*width/8;
-    m_InputSize = height*width;
-    m_OutputTensors.push_back(outputTensorSemi);
-    m_OutputTensors.push_back(outputTensorDesc);
-    std::cout << "Trying to init TRT engine of SuperPointTensorRT" << engine_path << std::endl;
-    init(engine_path);
+    bool _enable_perf,
+    const std::string & backend_type, int threads):
+    width(_width), height(_height), thres(_thres), max_num(_max_num), enable_perf(_enable_perf) {
+    std::vector<OutputBlob> outputs{
+        {"semi", (uint64_t) height*width},
+        {"desc", (uint64_t) 1*SP_DESC_RAW_LEN*height/8*width/8}
+    };
+    std::cout << "Trying to init SuperPointTensorRT on " << backend_type << " " << engine_path << std::endl;
+    backend = create_inference_backend(backend_type, engine_path, "image", outputs, width, height, threads);
 
     pca_comp_T = load_csv_mat_eigen(_pca_comp).transpose();
     pca_mean = load_csv_vec_eigen(_pca_mean).transpose();
+    if (pca_comp_T.rows() != SP_DESC_RAW_LEN || pca_mean.size() != SP_DESC_RAW_LEN || pca_comp_T.cols() != FEATURE_DESC_SIZE) {
+        std::cerr << "SuperPoint PCA " << _pca_comp << " must be " << FEATURE_DESC_SIZE << "x" << SP_DESC_RAW_LEN << " with mean of " << SP_DESC_RAW_LEN
+            << ", got " << pca_comp_T.cols() << "x" << pca_comp_T.rows() << " and " << pca_mean.size() << std::endl;
+        exit(-1);
+    }
+    pca_bias = pca_mean * pca_comp_T;
 
     std::cout << "pca_comp rows " << pca_comp_T.rows() << "cols " << pca_comp_T.cols() << std::endl;
     std::cout << "pca_mean " << pca_mean.size() << std::endl;
@@ -123,22 +135,12 @@ void SuperPointTensorRT::inference(const cv::Mat & input, std::vector<cv::Point2
     } else {
         input.convertTo(_input, CV_32F, 1/255.0);
     }
-    doInference(_input);
+    backend->doInference(_input);
     if (enable_perf) {
         std::cout << "Inference Time " << tic.toc();
     }
 
-    TicToc tic1;
-    auto options = torch::TensorOptions().dtype(torch::kFloat32);
-    
-    
-    
-    auto mProb = at::from_blob(m_OutputTensors[0].hostBuffer, {1, 1, height, width}, options);
-    auto mDesc = at::from_blob(m_OutputTensors[1].hostBuffer, {1, SP_DESC_RAW_LEN, height/8, width/8}, options);
-    cv::Mat Prob = cv::Mat(height, width, CV_32F, m_OutputTensors[0].hostBuffer);
-    if (enable_perf) {
-        std::cout << " from_blob " << tic1.toc();
-    }
+    cv::Mat Prob = cv::Mat(height, width, CV_32F, backend->output(0));
 
     TicToc tic2;
     getKeyPoints(Prob, thres, keypoints);
@@ -146,7 +148,7 @@ void SuperPointTensorRT::inference(const cv::Mat & input, std::vector<cv::Point2
         std::cout << " getKeyPoints " << tic2.toc();
     }
 
-    computeDescriptors(mProb, mDesc, keypoints, local_descriptors);
+    computeDescriptors(backend->output(1), keypoints, local_descriptors);
     
     if (enable_perf) {
         std::cout << " getKeyPoints+computeDescriptors " << tic2.toc() << "inference all" << tic.toc() << "features" << keypoints.size() << "desc size" << local_descriptors.size() << std::endl;
@@ -158,150 +160,171 @@ void SuperPointTensorRT::inference(const cv::Mat & input, std::vector<cv::Point2
     }
 }
 
+//Append pixels of a heatmap row above thres, most of a row is skipped 4 pixels at a time
+static void threshold_row(const float * row, int y, int width, float thres, std::vector<std::pair<float, int>> & candidates) {
+    int x = 0;
+#if defined(SUPERPOINT_SSE)
+    __m128 th = _mm_set1_ps(thres);
+    for (; x + 4 <= width; x += 4) {
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), th));
+        while (mask) {
+            int k = __builtin_ctz(mask);
+            candidates.emplace_back(row[x + k], y * width + x + k);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SUPERPOINT_NEON)
+    float32x4_t th = vdupq_n_f32(thres);
+    for (; x + 4 <= width; x += 4) {
+        uint32x4_t m = vcgtq_f32(vld1q_f32(row + x), th);
+        uint32x2_t m2 = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+        if (vget_lane_u32(vpmax_u32(m2, m2), 0) == 0) {
+            continue;
+        }
+        for (int k = 0; k < 4; k++) {
+            if (row[x + k] > thres) {
+                candidates.emplace_back(row[x + k], y * width + x + k);
+            }
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        if (row[x] > thres) {
+            candidates.emplace_back(row[x], y * width + x);
+        }
+    }
+}
+
 void SuperPointTensorRT::getKeyPoints(const cv::Mat & prob, float threshold, std::vector<cv::Point2f> &keypoints)
 {
-    TicToc getkps;
-    auto mask = (prob > threshold);
-    std::vector<cv::Point> kps;
-    cv::findNonZero(mask, kps);
-    std::vector<cv::Point2f> keypoints_no_nms;
-    for (int i = 0; i < kps.size(); i++) {
-        keypoints_no_nms.push_back(cv::Point2f(kps[i].x, kps[i].y));
+    TicToc ticnms;
+    candidates.clear();
+    for (int y = 0; y < height; y++) {
+        threshold_row(prob.ptr<float>(y), y, width, threshold, candidates);
     }
-
-    cv::Mat conf(keypoints_no_nms.size(), 1, CV_32F);
-    for (size_t i = 0; i < keypoints_no_nms.size(); i++) {
-        int x = keypoints_no_nms[i].x;
-        int y = keypoints_no_nms[i].y;
-        conf.at<float>(i, 0) = prob.at<float>(y, x);
+    int candidates_num = candidates.size();
+
+    //Greedy NMS from the strongest candidate, stops after max_num keypoints so only the top of the heap is ordered.
+    //A bucket of NMS_DIST pixels holds at most one kept keypoint, and all kept ones within NMS_DIST are in the 3x3 neighbour buckets.
+    const int grid_w = (width + NMS_DIST - 1) / NMS_DIST;
+    const int grid_h = (height + NMS_DIST - 1) / NMS_DIST;
+    nms_grid.assign(grid_w * grid_h, -1);
+    std::make_heap(candidates.begin(), candidates.end());
+    auto end = candidates.end();
+    while (end != candidates.begin() && (int) keypoints.size() < max_num) {
+        std::pop_heap(candidates.begin(), end);
+        end --;
+        int idx = end->second;
+        int x = idx % width;
+        int y = idx / width;
+        int cx = x / NMS_DIST;
+        int cy = y / NMS_DIST;
+        bool suppressed = false;
+        for (int gy = std::max(cy - 1, 0); gy <= std::min(cy + 1, grid_h - 1) && !suppressed; gy++) {
+            for (int gx = std::max(cx - 1, 0); gx <= std::min(cx + 1, grid_w - 1); gx++) {
+                int kept = nms_grid[gy * grid_w + gx];
+                if (kept >= 0 && std::abs(kept % width - x) <= NMS_DIST && std::abs(kept / width - y) <= NMS_DIST) {
+                    suppressed = true;
+                    break;
+                }
+            }
+        }
+        if (!suppressed) {
+            nms_grid[cy * grid_w + cx] = idx;
+            keypoints.push_back(cv::Point2f(x, y));
+        }
     }
 
-    int border = 0;
-    int dist_thresh = 4;
-    TicToc ticnms;
-    NMS2(keypoints_no_nms, conf, keypoints, border, dist_thresh, width, height, max_num);
     if (enable_perf) {
-        printf(" NMS %f keypoints_no_nms %ld keypoints %ld\n", ticnms.toc(), keypoints_no_nms.size(), keypoints.size());
+        printf(" NMS %f keypoints_no_nms %d keypoints %ld\n", ticnms.toc(), candidates_num, keypoints.size());
     }
 }
 
 
-void SuperPointTensorRT::computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & mDesc, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors) {
-    TicToc tic;
-    cv::Mat kpt_mat(keypoints.size(), 2, CV_32F);  // [n_keypoints, 2]  (y, x)
-    for (size_t i = 0; i < keypoints.size(); i++) {
-        kpt_mat.at<float>(i, 0) = (float)keypoints[i].y;
-        kpt_mat.at<float>(i, 1) = (float)keypoints[i].x;
-    }
-
+void sample_superpoint_descriptors(const float * desc_map, int width, int height, const std::vector<cv::Point2f> & keypoints,
+    bool per_channel_norm, std::vector<float> & desc) {
+    const int desc_w = width / 8;
+    const int desc_h = height / 8;
+    const int plane = desc_w * desc_h;
+    const int num = keypoints.size();
+    desc.resize(num * SP_DESC_RAW_LEN);
 
-    auto fkpts = torch::from_blob(kpt_mat.data, {keypoints.size(), 2}, torch::kFloat);
+    std::vector<float> channel_sqr;
+    if (per_channel_norm) {
+        channel_sqr.assign(SP_DESC_RAW_LEN, 0);
+    }
 
-    auto grid = torch::zeros({1, 1, fkpts.size(0), 2});  // [1, 1, n_keypoints, 2]
-    grid[0][0].slice(1, 0, 1) = 2.0 * fkpts.slice(1, 1, 2) / width - 1;  // x
-    grid[0][0].slice(1, 1, 2) = 2.0 * fkpts.slice(1, 0, 1) / height - 1;  // y
+    for (int i = 0; i < num; i++) {
+        float ix = keypoints[i].x * desc_w / width - 0.5f;
+        float iy = keypoints[i].y * desc_h / height - 0.5f;
+        int x0 = std::floor(ix);
+        int y0 = std::floor(iy);
+        float ax = ix - x0;
+        float ay = iy - y0;
+        float w[4] = {(1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay};
+        int offset[4];
+        for (int k = 0; k < 4; k++) {
+            int x = x0 + (k & 1);
+            int y = y0 + (k >> 1);
+            if (x >= 0 && x < desc_w && y >= 0 && y < desc_h) {
+                offset[k] = y * desc_w + x;
+            } else {
+                offset[k] = 0;
+                w[k] = 0;
+            }
+        }
 
-    // mDesc.to(torch::kCUDA);
-    // grid.to(torch::kCUDA);
-    auto desc = torch::grid_sampler(mDesc, grid, 0, 0, 0);
+        float * out = desc.data() + i * SP_DESC_RAW_LEN;
+        float sqr = 0;
+        for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+            const float * p = desc_map + c * plane;
+            float v = w[0] * p[offset[0]] + w[1] * p[offset[1]] + w[2] * p[offset[2]] + w[3] * p[offset[3]];
+            out[c] = v;
+            sqr += v * v;
+        }
+        if (per_channel_norm) {
+            for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                channel_sqr[c] += out[c] * out[c];
+            }
+        } else {
+            float inv_norm = 1.0f / std::max(std::sqrt(sqr), 1e-12f);
+            for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                out[c] *= inv_norm;
+            }
+        }
+    }
 
-    desc = desc.squeeze(0).squeeze(1);
+    if (per_channel_norm) {
+        //Same as desc.div(norm) in libtorch, a channel of all zero gives nan there and zero here
+        for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+            channel_sqr[c] = channel_sqr[c] > 0 ? 1.0f / std::sqrt(channel_sqr[c]) : 0;
+        }
+        for (int i = 0; i < num; i++) {
+            float * out = desc.data() + i * SP_DESC_RAW_LEN;
+            for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                out[c] *= channel_sqr[c];
+            }
+        }
+    }
+}
 
-    // normalize to 1
-    auto dn = torch::norm(desc, 2, 1);
-    desc = desc.div(torch::unsqueeze(dn, 1));
+void SuperPointTensorRT::computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors) {
+    TicToc tic;
+    const int num = keypoints.size();
+    sample_superpoint_descriptors(desc_map, width, height, keypoints, per_channel_norm, raw_desc);
 
-    desc = desc.transpose(0, 1).contiguous();
-    desc = desc.to(torch::kCPU);
-    Eigen::Map<Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>> _desc(desc.data<float>(), desc.size(0), desc.size(1));
 #ifdef USE_PCA
-    Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> _desc_new = (_desc.rowwise() - pca_mean) *pca_comp_T;
-    local_descriptors = std::vector<float>(_desc_new.data(), _desc_new.data()+_desc_new.cols()*_desc_new.rows());
+    typedef Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXf;
+    Eigen::Map<const RowMatrixXf> _desc(raw_desc.data(), num, SP_DESC_RAW_LEN);
+    local_descriptors.resize(num * pca_comp_T.cols());
+    Eigen::Map<RowMatrixXf> _desc_new(local_descriptors.data(), num, pca_comp_T.cols());
+    _desc_new.noalias() = _desc * pca_comp_T;
+    _desc_new.rowwise() -= pca_bias;
 #else
-    local_descriptors = std::vector<float>(_desc.data(), _desc.data()+_desc.cols()*_desc.rows());
+    local_descriptors = raw_desc;
 #endif
 
     if (enable_perf) {
         std::cout << " computeDescriptors full " << tic.toc() << std::endl;
     }
 }
-
-bool pt_conf_comp(std::pair<cv::Point2f, double> i1, std::pair<cv::Point2f, double> i2)
-{
-    return (i1.second > i2.second);
-}
-
-void NMS2(std::vector<cv::Point2f> det, cv::Mat conf, std::vector<cv::Point2f>& pts,
-            int border, int dist_thresh, int img_width, int img_height, int max_num)
-{
-
-    std::vector<cv::Point2f> pts_raw = det;
-
-    std::vector<std::pair<cv::Point2f, double>> pts_conf_vec;
-
-    cv::Mat grid = cv::Mat(cv::Size(img_width, img_height), CV_8UC1);
-    cv::Mat inds = cv::Mat(cv::Size(img_width, img_height), CV_16UC1);
-
-    cv::Mat confidence = cv::Mat(cv::Size(img_width, img_height), CV_32FC1);
-
-    grid.setTo(0);
-    inds.setTo(0);
-    confidence.setTo(0);
-
-    for (unsigned int i = 0; i < pts_raw.size(); i++)
-    {   
-        int uu = (int) pts_raw[i].x;
-        int vv = (int) pts_raw[i].y;
-
-        grid.at<char>(vv, uu) = 1;
-        inds.at<unsigned short>(vv, uu) = i;
-
-        confidence.at<float>(vv, uu) = conf.at<float>(i, 0);
-    }
-
-    for (int i = 0; i < pts_raw.size(); i++)
-    {   
-        int uu = (int) pts_raw[i].x;
-        int vv = (int) pts_raw[i].y;
-
-        if (grid.at<char>(vv, uu) != 1)
-            continue;
-
-        for(int k = -dist_thresh; k < (dist_thresh+1); k++)
-            for(int j = -dist_thresh; j < (dist_thresh+1); j++)
-            {
-                if(j==0 && k==0) continue;
-
-                if ( confidence.at<float>(vv + k, uu + j) < confidence.at<float>(vv, uu) ) {
-                    grid.at<char>(vv + k, uu + j) = 0;
-                }
-            }
-        grid.at<char>(vv, uu) = 2;
-    }
-
-    size_t valid_cnt = 0;
-
-    for (int v = 0; v < (img_height); v++){
-        for (int u = 0; u < (img_width); u++)
-        {
-            if (u>= (img_width - border) || u < border || v >= (img_height - border) || v < border)
-            continue;
-
-            if (grid.at<char>(v,u) == 2)
-            {
-                int select_ind = (int) inds.at<unsigned short>(v, u);
-                float _conf = confidence.at<float> (v, u);
-                cv::Point2f p = pts_raw[select_ind];
-                pts_conf_vec.push_back(std::make_pair(p, _conf));
-                valid_cnt++;
-            }
-        }
-    }
-    
-    std::sort(pts_conf_vec.begin(), pts_conf_vec.end(), pt_conf_comp);
-    for (unsigned int i = 0; i < max_num && i < pts_conf_vec.size(); i ++) {
-        pts.push_back(pts_conf_vec[i].first);
-        // printf("conf:%f\n", pts_conf_vec[i].second);
-    }
-
-}
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <nav_msgs/Odometry.h>
 #include <mutex>
 #include <swarm_msgs/node_frame.h>
+#include <boost/make_shared.hpp>
 
 #define BACKWARD_HAS_DW 1
 #include <backward.hpp>
@@ -56,7 +57,8 @@ void SwarmLoop::on_loop_connection (LoopConnection & loop_con, bool is_local) {
     }
 
     // ROS_INFO("Pub loop conn. is local %d", is_local);
-    loopconn_pub.publish(loop_con);
+    //Publish as shared_ptr so nodelets in the same manager receive it without a copy
+    loopconn_pub.publish(boost::make_shared<LoopConnection>(loop_con));
 }
 
 StereoFrame SwarmLoop::find_images_raw(const nav_msgs::Odometry & odometry) {
@@ -81,49 +83,49 @@ StereoFrame SwarmLoop::find_images_raw(const nav_msgs::Odometry & odometry) {
     return ret;
 }
 
-void SwarmLoop::flatten_raw_callback(const vins::FlattenImages & stereoframe) {
+void SwarmLoop::push_raw_stereo_frame(const StereoFrame & stereoframe) {
     raw_stereo_image_lock.lock();
-    // ROS_INFO("Received flatten_raw %f", stereoframe.header.stamp.toSec());
-    raw_stereo_images.push(StereoFrame(stereoframe));
+    raw_stereo_images.push(stereoframe);
+    //Frames are dropped by odometry, keep buffer bounded when odometry is missing
+    while (raw_stereo_images.size() > MAX_RAW_STEREO_FRAMES) {
+        raw_stereo_images.pop();
+    }
     raw_stereo_image_lock.unlock();
 }
 
+void SwarmLoop::flatten_raw_callback(const vins::FlattenImages & stereoframe) {
+    // ROS_INFO("Received flatten_raw %f", stereoframe.header.stamp.toSec());
+    push_raw_stereo_frame(StereoFrame(stereoframe));
+}
+
 void SwarmLoop::stereo_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right) {
     auto _l = getImageFromMsg(left);
     auto _r = getImageFromMsg(right);
-    raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(_l->header.stamp, 
+    push_raw_stereo_frame(StereoFrame(_l->header.stamp, 
         _l->image, _r->image, left_extrinsic, right_extrinsic, self_id));
-    raw_stereo_image_lock.unlock();
 }
 
 
 void SwarmLoop::comp_stereo_images_callback(const sensor_msgs::CompressedImageConstPtr left, const sensor_msgs::CompressedImageConstPtr right) {
     auto _l = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
     auto _r = getImageFromMsg(right, cv::IMREAD_GRAYSCALE);
-    raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
+    push_raw_stereo_frame(StereoFrame(left->header.stamp, 
         _l, _r, left_extrinsic, right_extrinsic, self_id));
-    raw_stereo_image_lock.unlock();
 }
 
 
 void SwarmLoop::comp_depth_images_callback(const sensor_msgs::CompressedImageConstPtr left, const sensor_msgs::ImageConstPtr depth) {
     auto _l = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
     auto _d = getImageFromMsg(depth);
-    raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
+    push_raw_stereo_frame(StereoFrame(left->header.stamp, 
         _l, _d->image, left_extrinsic, self_id));
-    raw_stereo_image_lock.unlock();
 }
 
 void SwarmLoop::depth_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr depth) {
     auto _l = getImageFromMsg(left);
     auto _d = getImageFromMsg(depth);
-    raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
+    push_raw_stereo_frame(StereoFrame(left->header.stamp, 
         _l->image, _d->image, left_extrinsic, self_id));
-    raw_stereo_image_lock.unlock();
 }
 
 void SwarmLoop::odometry_callback(const nav_msgs::Odometry & odometry) {
@@ -167,9 +169,6 @@ void SwarmLoop::VIOnonKF_callback(const StereoFrame & stereoframe) {
 }
 
 void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe) {
-    Eigen::Vector3d drone_pos(stereoframe.pose_drone.position.x, stereoframe.pose_drone.position.y, stereoframe.pose_drone.position.z);
-    double dpos = (last_keyframe_position - drone_pos).norm();
-
     if (stereoframe.stamp.toSec() - last_invoke < 1/max_freq) {
         return;
     }
@@ -178,6 +177,23 @@ void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe
     
     last_kftime = stereoframe.stamp;
 
+    if (enable_pipeline) {
+        KeyframeJob job;
+        job.frame = stereoframe;
+        job.nonkeyframe = nonkeyframe;
+        if (!extract_queue.push(job)) {
+            ROS_WARN("Extract stage is busy, dropped %d keyframes", extract_queue.dropped_num());
+        }
+        return;
+    }
+
+    process_keyframe(stereoframe, nonkeyframe);
+}
+
+void SwarmLoop::process_keyframe(const StereoFrame & stereoframe, bool nonkeyframe) {
+    Eigen::Vector3d drone_pos(stereoframe.pose_drone.position.x, stereoframe.pose_drone.position.y, stereoframe.pose_drone.position.z);
+    double dpos = (last_keyframe_position - drone_pos).norm();
+
     auto start = high_resolution_clock::now();
     std::vector<cv::Mat> imgs;
     
@@ -193,9 +209,55 @@ void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe
     recived_image = true;
     last_keyframe_position = drone_pos;
 
-    loop_net->broadcast_fisheye_desc(ret);
+    if (enable_pipeline) {
+        if (!broadcast_queue.push(ret)) {
+            ROS_WARN("Broadcast stage is busy, dropped %d keyframes", broadcast_queue.dropped_num());
+        }
+        DetectJob job;
+        job.frame_desc = ret;
+        job.imgs = imgs;
+        if (!detect_queue.push(job)) {
+            ROS_WARN("Detect stage is busy, dropped %d local keyframes", detect_queue.dropped_num());
+        }
+        return;
+    }
+
+    broadcast_keyframe(ret);
     loop_detector->on_image_recv(ret, imgs);
-    pub_node_frame(ret);
+}
+
+void SwarmLoop::broadcast_keyframe(FisheyeFrameDescriptor_t & frame_desc) {
+    loop_net->broadcast_fisheye_desc(frame_desc);
+    pub_node_frame(frame_desc);
+}
+
+void SwarmLoop::start_pipeline(int queue_size, bool drop_oldest) {
+    extract_queue.configure(queue_size, drop_oldest);
+    broadcast_queue.configure(queue_size, drop_oldest);
+    detect_queue.configure(queue_size, drop_oldest);
+
+    extract_thread = std::thread([&] {
+        KeyframeJob job;
+        while (extract_queue.pop(job)) {
+            process_keyframe(job.frame, job.nonkeyframe);
+        }
+    });
+
+    broadcast_thread = std::thread([&] {
+        FisheyeFrameDescriptor_t frame_desc;
+        while (broadcast_queue.pop(frame_desc)) {
+            broadcast_keyframe(frame_desc);
+        }
+    });
+
+    //Local and remote frames are all detected in this stage, so LoopDetector is used by one thread only.
+    //Only local keyframes are bounded by queue size, remote ones wait in queue until detected
+    detect_thread = std::thread([&] {
+        DetectJob job;
+        while (detect_queue.pop(job)) {
+            loop_detector->on_image_recv(job.frame_desc, job.imgs);
+        }
+    });
 }
 
 void SwarmLoop::pub_node_frame(const FisheyeFrameDescriptor_t & viokf) {
@@ -222,12 +284,30 @@ void SwarmLoop::on_remote_frame_ros(const swarm_msgs::FisheyeFrameDescriptor & r
 }
 
 void SwarmLoop::on_remote_image(const FisheyeFrameDescriptor_t & frame_desc) {
+    if (enable_pipeline) {
+        //Remote keyframes are received only once, never drop them
+        DetectJob job;
+        job.frame_desc = frame_desc;
+        detect_queue.push(job, false);
+        return;
+    }
     loop_detector->on_image_recv(frame_desc);
 }
 
 
 SwarmLoop::SwarmLoop () {}
 
+SwarmLoop::~SwarmLoop() {
+    extract_queue.close();
+    broadcast_queue.close();
+    detect_queue.close();
+    for (auto th : {&extract_thread, &broadcast_thread, &detect_thread}) {
+        if (th->joinable()) {
+            th->join();
+        }
+    }
+}
+
 void SwarmLoop::Init(ros::NodeHandle & nh) {
     //Init Loop Net
     std::string _lcm_uri = "0.0.0.0";
@@ -236,6 +316,7 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     std::string netvlad_model_path = "";
     std::string vins_config_path;
     std::string _pca_comp_path, _pca_mean_path;
+    std::string _netvlad_pca_comp_path, _netvlad_pca_mean_path;
     std::string IMAGE0_TOPIC, IMAGE1_TOPIC, COMP_IMAGE0_TOPIC, COMP_IMAGE1_TOPIC, DEPTH_TOPIC;
     int width;
     int height;
@@ -269,6 +350,32 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     nh.param<double>("detector_match_thres", DETECTOR_MATCH_THRES, 0.9);
     nh.param<bool>("lower_cam_as_main", LOWER_CAM_AS_MAIN, false);
     nh.param<bool>("output_raw_superpoint_desc", OUTPUT_RAW_SUPERPOINT_DESC, false);
+    nh.param<bool>("superpoint_per_channel_norm", SUPERPOINT_PER_CHANNEL_NORM, true);
+    nh.param<bool>("output_raw_netvlad_desc", OUTPUT_RAW_NETVLAD_DESC, false);
+    nh.param<std::string>("loop_index_type", LOOP_INDEX_TYPE, "flat");
+    nh.param<int>("loop_index_nlist", LOOP_INDEX_NLIST, 32);
+    nh.param<int>("loop_index_train_size", LOOP_INDEX_TRAIN_SIZE, 1000);
+    nh.param<int>("loop_index_nprobe", LOOP_INDEX_NPROBE, 4);
+    nh.param<int>("loop_index_hnsw_m", LOOP_INDEX_HNSW_M, 32);
+    nh.param<int>("loop_index_pq_m", LOOP_INDEX_PQ_M, 16);
+    nh.param<int>("loop_index_rerank_num", LOOP_INDEX_RERANK_NUM, 20);
+    nh.param<double>("loop_db_max_mb", LOOP_DB_MAX_MB, 1024);
+    nh.param<double>("loop_db_dedup_dis", LOOP_DB_DEDUP_DIS, 0.2);
+    nh.param<double>("loop_db_dedup_yaw", LOOP_DB_DEDUP_YAW, 10);
+    nh.param<double>("loop_db_dedup_product", LOOP_DB_DEDUP_PRODUCT, 0.95);
+    nh.param<bool>("feature_match_int8", FEATURE_MATCH_INT8, false);
+    nh.param<double>("feature_match_ratio", FEATURE_MATCH_RATIO, 1.0);
+    nh.param<int>("dir_worker_num", DIR_WORKER_NUM, -1);
+    nh.param<std::string>("cnn_backend", LOOP_CNN_BACKEND, "tensorrt");
+    nh.param<int>("cnn_threads", LOOP_CNN_THREADS, 1);
+    if (LOOP_CNN_BACKEND == "opencv" && LOOP_CNN_THREADS != 1) {
+        ROS_WARN("cnn_threads is used by onnxruntime only, OpenCV DNN runs on cv::setNumThreads(1) of swarm_loop");
+    }
+    int keyframe_queue_size;
+    std::string keyframe_queue_drop;
+    nh.param<bool>("enable_pipeline", enable_pipeline, true);
+    nh.param<int>("keyframe_queue_size", keyframe_queue_size, 2);
+    nh.param<std::string>("keyframe_queue_drop", keyframe_queue_drop, "oldest");
 
     nh.param<double>("triangle_thres", TRIANGLE_THRES, 0.006);
     nh.param<double>("depth_far_thres", DEPTH_FAR_THRES, 10.0);
@@ -282,6 +389,8 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     nh.param<std::string>("vins_config_path",vins_config_path, "");
     nh.param<std::string>("pca_comp_path",_pca_comp_path, "");
     nh.param<std::string>("pca_mean_path",_pca_mean_path, "");
+    nh.param<std::string>("netvlad_pca_comp_path", _netvlad_pca_comp_path, "");
+    nh.param<std::string>("netvlad_pca_mean_path", _netvlad_pca_mean_path, "");
     nh.param<std::string>("camera_config_path",camera_config_path, 
         "/home/xuhao/swarm_ws/src/VINS-Fusion-gpu/config/vi_car/cam0_mei.yaml");
     nh.param<std::string>("superpoint_model_path", superpoint_model_path, "");
@@ -305,6 +414,12 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
         exit(-1);
     }
 
+    //One worker per extra direction at most, single direction cameras run serially
+    if (DIR_WORKER_NUM < 0 || DIR_WORKER_NUM > MAX_DIRS - 1) {
+        DIR_WORKER_NUM = std::max(MAX_DIRS - 1, 0);
+    }
+    ROS_INFO("Direction workers %d for %d directions", DIR_WORKER_NUM, MAX_DIRS);
+
     fsSettings["image0_topic"] >> IMAGE0_TOPIC;
     fsSettings["image1_topic"] >> IMAGE1_TOPIC;
 
@@ -328,7 +443,8 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     
     loop_net = new LoopNet(_lcm_uri, send_img, send_whole_img_desc, recv_msg_duration);
     loop_cam = new LoopCam(camera_configuration, camera_config_path, superpoint_model_path, _pca_comp_path, _pca_mean_path, 
-        superpoint_thres, superpoint_max_num, netvlad_model_path, width, height, self_id, send_img, nh);
+        superpoint_thres, superpoint_max_num, netvlad_model_path, _netvlad_pca_comp_path, _netvlad_pca_mean_path, 
+        width, height, self_id, send_img, nh);
         
     loop_cam->show = debug_image; 
     loop_detector = new LoopDetector();
@@ -408,6 +524,11 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     }
     
 
+    if (enable_pipeline) {
+        ROS_INFO("Keyframe pipeline with queue size %d, drop %s when full", keyframe_queue_size, keyframe_queue_drop.c_str());
+        start_pipeline(std::max(keyframe_queue_size, 1), keyframe_queue_drop != "newest");
+    }
+
     timer = nh.createTimer(ros::Duration(0.01), [&](const ros::TimerEvent & e) {
         loop_net->scan_recv_packets();
     });
@@ -5,10 +5,24 @@ using namespace nvinfer1;
 uint64_t get3DTensorVolume4(nvinfer1::Dims inputDims);
 
 TensorRTInferenceGeneric::TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height):
-    m_InputBlobName(input_blob_name), width(_width), height(_height){
+    InferenceBackend(_width, _height), m_InputBlobName(input_blob_name) {
 
 }
 
+TensorRTInferenceGeneric::TensorRTInferenceGeneric(const std::string & engine_path, std::string input_blob_name, const std::vector<OutputBlob> & outputs, 
+    int _width, int _height):
+    InferenceBackend(_width, _height), m_InputBlobName(input_blob_name) {
+    m_InputSize = height*width;
+    for (auto & blob : outputs) {
+        TensorInfo tensor;
+        tensor.blobName = blob.name;
+        tensor.volume = blob.volume;
+        m_OutputTensors.push_back(tensor);
+    }
+    std::cout << "Trying to init TRT engine " << engine_path << std::endl;
+    init(engine_path);
+}
+
 void TensorRTInferenceGeneric::init(const std::string & engine_path) {
 
     m_Engine = loadTRTEngine(engine_path, nullptr, m_Logger);